@@ -1,9 +1,18 @@
 #pragma once
 #include "SRCommon.h"
+#include "SpscRing.h"
+#include "Export.h"
+
+#include <atomic>
 
 namespace SR
 {
 	struct Song;
+	struct RenderState;
+	class SpriteCanvas;
+	class SoftwareCanvas;
+	class BitmapFont;
+	class WorkerPool;
 
     class App : public Apoc3DEx::Game
 	{
@@ -37,59 +46,115 @@ namespace SR
 		void MenuItem_ApplyPitchShift(MenuItem* c);
 		void UpdatePitchShiftOptionTexts();
 
+		void MenuItem_ApplyExportFormat(MenuItem* c);
+		void UpdateExportFormatOptionTexts();
+
 		void SetExport(const String& fp);
+		/** Logs the error and shows it in a message box */
+		void ShowError(const String& title, const String& text);
 
 		Form* m_aboutDlg;
 
 		MenuBar* m_mainMenu;
 		SubMenu* m_pitchShiftMenu = nullptr;
+		SubMenu* m_exportFormatMenu = nullptr;
 
 		ProgressBar* m_exportBar = nullptr;
 
 		Sprite* m_sprite;
+		SpriteCanvas* m_canvas = nullptr;
 		Song* m_currentSong = nullptr;
 		String m_currentSongPath;
+		String m_noteCacheDir;
 		float m_viewingYScroll = 0;
 		float m_timeResolution = 100;
 		int32 m_pitchShift = 0;
 
 		MessageDialogBox* m_msgDlg_fileOverwrite = nullptr;
+		MessageDialogBox* m_msgDlg_error = nullptr;
 		String m_choosenExportPath;
 
-		RenderTarget* m_exportBuffer = nullptr;
+		BitmapFont* m_exportFont = nullptr;
+		PngColorMode m_exportColorMode = PNGCOL_RGB;
 
 		class ExportSession* m_exportSession = nullptr;
     };
 
 
-	class ExportSession
+	/**
+	 *  Renders and encodes a song to a PNG in the background, as fast as it
+	 *  goes. The UI only polls the progress. Batches of strips are rendered
+	 *  on the worker pool while a thread of their own encodes the previous
+	 *  ones, with the strip buffers passed between them through a ring.
+	 *  The encoder deflates in parallel on a second pool.
+	 *  Deleting the session stops it after the batch being rendered.
+	 */
+	class ExportSession : private BackgroundSequencialWorker<int32>
 	{
 	public:
-		ExportSession(float timeRes, double songDuration, int32 pitchShift, const String& exportPath, RenderTarget* exportBuffer);
+		ExportSession(const Song* song, float timeRes, int32 pitchShift, const String& exportPath, int32 width, int32 passHeight, const BitmapFont* font, PngColorMode colorMode);
 		~ExportSession();
 
-		void DoStep(Sprite* spr, RenderDevice* dev, RenderTarget* rt, Song* song);
+		/** True once the whole image is written */
+		bool isFinished() const { return m_finished; }
+
+		/** True if the image could not be written, which stops the export. getError() tells why. */
+		bool hasFailed() const { return m_failed; }
+		const String& getError() const { return m_error; }
 
-		bool isFinished() const { return m_currentPass >= m_passCount; }
-		
 		float GetProgress() const;
 	private:
+		/** Renders the batch of strips starting at the given one into free ring slots */
+		virtual void BackgroundMainProcess(int32& batchStart) override;
+
+		static void EncoderMainStatic(void* session);
+		void EncoderMain();
+
+		static const int32 StripHeight = 48;
+
+		/** Seconds each side spent working or waiting for the other */
+		struct Telemetry
+		{
+			double renderBusy = 0;
+			double renderStall = 0;
+			double encodeBusy = 0;
+			double encodeStall = 0;
+		};
+
+		/** A strip buffer and the render state of whichever thread fills it */
+		struct StripSlot
+		{
+			SoftwareCanvas* canvas;
+			RenderState* renderState;
+		};
+
 		FileOutStream* m_fileOutStream = nullptr;
 
-		int32 m_currentPass = 0;
-		int32 m_currentPassStage = 0;
-		int32 m_currentSaveRow = 0;
+		List<ExportStrip> m_strips;					/** in image order, top down */
+		List<StripSlot> m_slots;				/** one per ring slot */
+		SpscRing m_ring;
+		int32 m_batchSize;
+
+		tthread::thread* m_encoderThread = nullptr;
+		std::atomic<bool> m_cancelled;
+		std::atomic<bool> m_finished;
+		std::atomic<bool> m_failed;
+		String m_error;							/** set by the encoder before m_failed */
+
+		Telemetry m_telemetry;
+
+		const Song* m_song;
 
-		int32 m_passCount = 0;
 		int32 m_bufWidth = 0;
 		int32 m_bufHeight = 0;
 		int32 m_contentHeight = 0;
 
-		float m_songDuration = 0;
 		float m_timeResolution = 0;
 		int32 m_pitchShift = 0;
 
-		struct PngSaveContext* m_pngSave = nullptr;
+		WorkerPool* m_encodePool = nullptr;
+		ParallelPngWriter* m_pngWriter = nullptr;
+		PaletteQuantizer* m_quantizer = nullptr;
 
 	};
 
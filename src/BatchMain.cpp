@@ -0,0 +1,294 @@
+#include "Export.h"
+#include "Song.h"
+#include "SoftwareCanvas.h"
+#include "WorkerPool.h"
+#include "Library/MidiEventStore.h"
+
+#include <Windows.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+
+using namespace SR;
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	double SecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	struct SongResult
+	{
+		bool exported = false;
+		int32 height = 0;
+		int64 fileSize = 0;
+	};
+
+	void PrintUsage()
+	{
+		wprintf(L"Exports MIDI files to PNG key maps without a window.\n\n"
+			L"SRBatch [options] <file or directory>...\n\n"
+			L"  -r <pixels>      pixels per second of song, 100 by default\n"
+			L"  -w <pixels>      image width, 1280 by default\n"
+			L"  -p <semitones>   pitch shift, from %d to %d\n"
+			L"  -f rgba|rgb|256  color format, rgb by default\n"
+			L"  -j <count>       songs exported at once, one per core by default\n"
+			L"  -o <directory>   where images go, next to each song by default\n"
+			L"  -c <directory>   keeps decoded songs there, to skip decoding them next time\n"
+			L"  -t <tracks>      only these tracks, such as 1,2, counting from 0\n"
+			L"  -x <channels>    leaves out these channels, such as 10 for drums, counting from 1\n\n"
+			L"Directories are searched for .mid and .midi files, including subdirectories.\n",
+			MinPitchShift, MaxPitchShift);
+	}
+
+	bool IsMidiFile(const String& path)
+	{
+		return StringUtils::EndsWith(path, L".mid", true) || StringUtils::EndsWith(path, L".midi", true);
+	}
+
+	/** Adds the songs a command line argument names. False if it names nothing. */
+	bool CollectSongs(const String& arg, List<String>& songs)
+	{
+		if (File::DirectoryExists(arg))
+		{
+			List<String> items;
+			File::ListDirectoryFilesRecursive(arg, items);
+
+			for (const String& item : items)
+			{
+				if (IsMidiFile(item))
+					songs.Add(PathUtils::Combine(arg, item));
+			}
+			return true;
+		}
+
+		if (File::FileExists(arg))
+		{
+			songs.Add(arg);
+			return true;
+		}
+		return false;
+	}
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+	ExportSettings settings;
+	int32 threadCount = 0;
+	String outputDir;
+	String cacheDir;
+	MidiReadFilter filter;
+	bool filtered = false;
+	List<String> inputs;
+
+	for (int i = 1; i < argc; i++)
+	{
+		String arg = argv[i];
+
+		if (arg.size() == 2 && arg[0] == '-')
+		{
+			if (i + 1 >= argc)
+			{
+				PrintUsage();
+				return 2;
+			}
+
+			String val = argv[++i];
+
+			switch (arg[1])
+			{
+				case 'r': settings.timeResolution = StringUtils::ParseSingle(val); break;
+				case 'w': settings.width = StringUtils::ParseInt32(val); break;
+				case 'p': settings.pitchShift = StringUtils::ParseInt32(val); break;
+				case 'j': threadCount = StringUtils::ParseInt32(val); break;
+				case 'o': outputDir = val; break;
+				case 'c': cacheDir = val; break;
+				case 't':
+					for (const String& t : StringUtils::Split(val, L","))
+						filter.tracks.push_back(StringUtils::ParseInt32(t));
+					filtered = true;
+					break;
+				case 'x':
+					for (const String& c : StringUtils::Split(val, L","))
+						filter.channels &= ~(1u << ((StringUtils::ParseInt32(c) - 1) & 15));
+					filtered = true;
+					break;
+				case 'f':
+					if (StringUtils::EqualsNoCase(val, L"rgba"))
+						settings.colorMode = PNGCOL_RGBA;
+					else if (StringUtils::EqualsNoCase(val, L"rgb"))
+						settings.colorMode = PNGCOL_RGB;
+					else if (val == L"256")
+						settings.colorMode = PNGCOL_Palette;
+					else
+					{
+						PrintUsage();
+						return 2;
+					}
+					break;
+				default:
+					PrintUsage();
+					return 2;
+			}
+		}
+		else
+		{
+			inputs.Add(arg);
+		}
+	}
+
+	if (inputs.getCount() == 0 || settings.timeResolution <= 0 || settings.width <= 0 ||
+		settings.pitchShift < MinPitchShift || settings.pitchShift > MaxPitchShift)
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	wchar_t workingDir[260];
+	GetCurrentDirectory(260, workingDir);
+
+	ManualStartConfig escon;
+	escon.WorkingDirectories.Add(workingDir);
+
+	wchar_t exePath[260];
+	GetModuleFileName(0, exePath, 260);
+	escon.WorkingDirectories.Add(PathUtils::GetDirectory(exePath));
+
+	escon.ModelAsync = false;
+	escon.TextureAsync = false;
+
+	Engine::Initialize(&escon);
+
+	PakArchiveFactory* pakSupport = new PakArchiveFactory();
+	FileSystem::getSingleton().RegisterArchiveType(pakSupport);
+
+	int32 failed = 0;
+
+	BitmapFont font;
+	bool fontLoaded = font.Load(FileSystem::getSingleton().Locate(L"Bender_Black_14_O.fnt", FileLocateRule::Default));
+	if (!fontLoaded)
+		wprintf(L"Can not load the font.\n");
+
+	List<String> songs;
+	for (const String& in : inputs)
+	{
+		if (!CollectSongs(in, songs))
+		{
+			wprintf(L"%ls: not found\n", in.c_str());
+			failed++;
+		}
+	}
+
+	if (outputDir.size() && !PrepareDirectory(outputDir))
+	{
+		wprintf(L"%ls: can not write images there\n", outputDir.c_str());
+		songs.Clear();
+		failed++;
+	}
+
+	// songs are only slower without a cache, so that is no reason to stop
+	if (cacheDir.size() && !PrepareDirectory(cacheDir))
+	{
+		wprintf(L"%ls: can not write there, songs will not be cached\n", cacheDir.c_str());
+		cacheDir.clear();
+	}
+
+	if (fontLoaded && songs.getCount() > 0)
+	{
+		List<SongResult> results;
+		results.Reserve(songs.getCount());
+
+		// a song per thread at a time. Threads share nothing but the font,
+		// and take the next song when done, so long songs balance out.
+		WorkerPool songPool(threadCount);
+		std::atomic<int32> nextSong(0);
+
+		Clock::time_point batchStart = Clock::now();
+
+		songPool.ParallelFor(songPool.getThreadCount(), [&](int32)
+		{
+			SerialExporter exporter(settings, &font);
+
+			for (int32 i = nextSong++; i < songs.getCount(); i = nextSong++)
+			{
+				const String& path = songs[i];
+				String imagePath = PathUtils::GetFileNameNoExt(path) + L".png";
+				imagePath = PathUtils::Combine(outputDir.size() ? outputDir : PathUtils::GetDirectory(path), imagePath);
+
+				// an image that can not be written throws, which would end the
+				// whole batch on this thread. It only fails this song.
+				try
+				{
+					Clock::time_point loadStart = Clock::now();
+
+					// each thread already has a song of its own, so the song is
+					// decoded on this thread instead of queueing on the default pool
+					Song song;
+					if (!song.Open(path, cacheDir, filtered ? &filter : nullptr, nullptr))
+					{
+						wprintf(L"[%d/%d] %ls: not a MIDI file that can be read\n", i + 1, songs.getCount(), PathUtils::GetFileName(path).c_str());
+						continue;
+					}
+
+					double loadTime = SecondsSince(loadStart);
+					Clock::time_point exportStart = Clock::now();
+
+					SongResult& result = results[i];
+					result.height = exporter.Export(&song, imagePath);
+					result.exported = result.height > 0;
+
+					double exportTime = SecondsSince(exportStart);
+
+					if (result.exported)
+					{
+						result.fileSize = File::GetFileSize(imagePath);
+
+						wprintf(L"[%d/%d] %ls: %d notes, %dx%d, load %.2fs, export %.2fs, %.1f MB\n",
+							i + 1, songs.getCount(), PathUtils::GetFileName(path).c_str(), song.m_notes.getCount(),
+							settings.width, result.height, loadTime, exportTime, result.fileSize / 1048576.0);
+					}
+					else
+					{
+						wprintf(L"[%d/%d] %ls: no notes, skipped\n", i + 1, songs.getCount(), PathUtils::GetFileName(path).c_str());
+					}
+				}
+				catch (const Exception& e)
+				{
+					wprintf(L"[%d/%d] %ls: %ls\n", i + 1, songs.getCount(), PathUtils::GetFileName(path).c_str(), e.getMessage().c_str());
+					results[i].exported = false;
+				}
+			}
+		});
+
+		double total = Math::Max(SecondsSince(batchStart), 0.001);
+
+		int32 exported = 0;
+		double pixels = 0;
+		double bytes = 0;
+		for (const SongResult& r : results)
+		{
+			if (r.exported)
+			{
+				exported++;
+				pixels += (double)settings.width * r.height;
+				bytes += (double)r.fileSize;
+			}
+		}
+		failed += songs.getCount() - exported;
+
+		wprintf(L"\n%d of %d songs in %.2fs on %d threads: %.2f songs/s, %.1f Mpixels/s, %.1f MB/s written\n",
+			exported, songs.getCount(), total, songPool.getThreadCount(),
+			exported / total, pixels / total / 1e6, bytes / total / 1048576.0);
+	}
+
+	FileSystem::getSingleton().UnregisterArchiveType(pakSupport);
+	delete pakSupport;
+
+	Engine::Shutdown();
+
+	return fontLoaded && failed == 0 ? 0 : 1;
+}
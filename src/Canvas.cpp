@@ -0,0 +1,64 @@
+#include "Canvas.h"
+
+namespace SR
+{
+	Rectangle Canvas::getVisibleArea() const
+	{
+		Size size = getSize();
+		return Rectangle(0, 0, size.Width, size.Height);
+	}
+
+	void Canvas::DrawRoundedRectWithBorder(const Rectangle& rect, float cornerRadius, int32 div, ColorValue color,
+		float borderWidth, float borderRadius, ColorValue borderColor)
+	{
+		DrawRoundedRect(rect, cornerRadius, div, color);
+		DrawRoundedRectBorder(rect, borderWidth, borderRadius, div, borderColor);
+	}
+
+	SpriteCanvas::SpriteCanvas(Sprite* sprite, Font* font)
+		: m_sprite(sprite), m_font(font)
+	{
+
+	}
+
+	Size SpriteCanvas::getSize() const
+	{
+		Viewport vp = m_sprite->getRenderDevice()->getViewport();
+		return Size(vp.Width, vp.Height);
+	}
+
+	void SpriteCanvas::FillRect(const Rectangle& rect, ColorValue color)
+	{
+		m_sprite->Draw(SystemUI::GetWhitePixel(), rect, nullptr, color);
+	}
+
+	void SpriteCanvas::DrawLine(const Point& start, const Point& end, ColorValue color, float width)
+	{
+		m_sprite->DrawLine(SystemUI::GetWhitePixel(), start, end, color, width, LineCapOptions::Butt);
+	}
+
+	void SpriteCanvas::DrawRoundedRect(const Rectangle& rect, float cornerRadius, int32 div, ColorValue color)
+	{
+		m_sprite->DrawRoundedRect(SystemUI::GetWhitePixel(), rect, nullptr, cornerRadius, div, color);
+	}
+
+	void SpriteCanvas::DrawRoundedRectBorder(const Rectangle& rect, float width, float cornerRadius, int32 div, ColorValue color)
+	{
+		m_sprite->DrawRoundedRectBorder(SystemUI::GetWhitePixel(), rect, nullptr, width, cornerRadius, div, color);
+	}
+
+	Point SpriteCanvas::MeasureString(const String& text)
+	{
+		return m_font->MeasureString(text);
+	}
+
+	void SpriteCanvas::DrawString(const String& text, const Point& pos, ColorValue color)
+	{
+		m_font->DrawString(m_sprite, text, pos, color);
+	}
+
+	void SpriteCanvas::Flush()
+	{
+		m_sprite->Flush();
+	}
+}
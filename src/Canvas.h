@@ -0,0 +1,58 @@
+#pragma once
+
+#include "SRCommon.h"
+
+namespace SR
+{
+	/**
+	 *  The drawing operations Song::Render needs. SpriteCanvas draws with the
+	 *  engine's Sprite on the render device, SoftwareCanvas rasterizes into
+	 *  a pixel buffer in memory and needs no device at all.
+	 */
+	class Canvas
+	{
+	public:
+		virtual ~Canvas() { }
+
+		virtual Size getSize() const = 0;
+
+		/** The part of the getSize() area that is actually drawn to. Everything by default. */
+		virtual Rectangle getVisibleArea() const;
+
+		virtual void FillRect(const Rectangle& rect, ColorValue color) = 0;
+		virtual void DrawLine(const Point& start, const Point& end, ColorValue color, float width) = 0;
+		virtual void DrawRoundedRect(const Rectangle& rect, float cornerRadius, int32 div, ColorValue color) = 0;
+		virtual void DrawRoundedRectBorder(const Rectangle& rect, float width, float cornerRadius, int32 div, ColorValue color) = 0;
+
+		/** A filled rounded rect with a border on top. Canvases that can do both in one go override this. */
+		virtual void DrawRoundedRectWithBorder(const Rectangle& rect, float cornerRadius, int32 div, ColorValue color,
+			float borderWidth, float borderRadius, ColorValue borderColor);
+
+		virtual Point MeasureString(const String& text) = 0;
+		virtual void DrawString(const String& text, const Point& pos, ColorValue color) = 0;
+
+		virtual void Flush() { }
+	};
+
+	class SpriteCanvas : public Canvas
+	{
+	public:
+		SpriteCanvas(Sprite* sprite, Font* font);
+
+		virtual Size getSize() const override;
+
+		virtual void FillRect(const Rectangle& rect, ColorValue color) override;
+		virtual void DrawLine(const Point& start, const Point& end, ColorValue color, float width) override;
+		virtual void DrawRoundedRect(const Rectangle& rect, float cornerRadius, int32 div, ColorValue color) override;
+		virtual void DrawRoundedRectBorder(const Rectangle& rect, float width, float cornerRadius, int32 div, ColorValue color) override;
+
+		virtual Point MeasureString(const String& text) override;
+		virtual void DrawString(const String& text, const Point& pos, ColorValue color) override;
+
+		virtual void Flush() override;
+
+	private:
+		Sprite* m_sprite;
+		Font* m_font;
+	};
+}
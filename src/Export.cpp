@@ -0,0 +1,98 @@
+#include "Export.h"
+#include "Song.h"
+#include "SoftwareCanvas.h"
+#include "WorkerPool.h"
+
+namespace SR
+{
+	int32 GetExportHeight(double duration, float timeRes)
+	{
+		return Math::Max(0, Math::Round(duration * timeRes));
+	}
+
+	int32 PlanExportStrips(double duration, float timeRes, int32 passHeight, int32 stripHeight, List<ExportStrip>& strips)
+	{
+		float songDuration = (float)duration;
+		int32 contentHeight = GetExportHeight(duration, timeRes);
+
+		int32 passCount = (contentHeight + passHeight - 1) / passHeight;
+
+		// the image is written top down, so the end of the song comes first.
+		// Passes keep their scroll positions and are cut into strips, which
+		// render on their own and give the same pixels however they are shared out.
+		for (int32 pass = 0; pass < passCount; pass++)
+		{
+			int32 yPos = passHeight * (passCount - pass - 1);
+			int32 height = Math::Min(contentHeight - yPos, passHeight);
+
+			ExportStrip strip;
+			strip.yScroll = songDuration * yPos / contentHeight;
+
+			for (strip.top = passHeight - height; strip.top < passHeight; strip.top += stripHeight)
+			{
+				strip.height = Math::Min(stripHeight, passHeight - strip.top);
+				strips.Add(strip);
+			}
+		}
+
+		return contentHeight;
+	}
+
+	void GetExportColors(List<ColorValue>& colors)
+	{
+		colors.Add(BackgroundColor);
+		Song::GetRenderColors(colors);
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	SerialExporter::SerialExporter(const ExportSettings& settings, const BitmapFont* font)
+		: m_settings(settings)
+	{
+		m_canvas = new SoftwareCanvas(m_settings.width, m_settings.passHeight, font);
+		m_renderState = new RenderState();
+		m_encodePool = new WorkerPool(1);
+
+		if (m_settings.colorMode == PNGCOL_Palette)
+		{
+			List<ColorValue> colors;
+			GetExportColors(colors);
+
+			m_quantizer = new PaletteQuantizer(colors);
+		}
+	}
+
+	SerialExporter::~SerialExporter()
+	{
+		DELETE_AND_NULL(m_quantizer);
+		DELETE_AND_NULL(m_encodePool);
+		DELETE_AND_NULL(m_renderState);
+		DELETE_AND_NULL(m_canvas);
+	}
+
+	int32 SerialExporter::Export(const Song* song, const String& path)
+	{
+		m_strips.Clear();
+		int32 height = PlanExportStrips(song->m_duration, m_settings.timeResolution, m_settings.passHeight, m_settings.passHeight, m_strips);
+
+		if (height <= 0)
+			return 0;
+
+		FileOutStream strm(path);
+		ParallelPngWriter writer(m_settings.width, height, strm, *m_encodePool, PNGPROF_FlatColor, m_settings.colorMode, m_quantizer);
+
+		for (const ExportStrip& strip : m_strips)
+		{
+			m_canvas->SetWindow(strip.top, m_settings.passHeight);
+			m_canvas->Clear(BackgroundColor);
+
+			song->Render(m_canvas, strip.yScroll, m_settings.timeResolution, m_settings.pitchShift, *m_renderState);
+
+			writer.WriteRows(m_canvas->getPixels(), m_canvas->getPitch(), strip.height);
+		}
+
+		writer.Finish();
+
+		return height;
+	}
+}
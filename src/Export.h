@@ -0,0 +1,75 @@
+#pragma once
+
+#include "SRCommon.h"
+#include "PngWriter.h"
+
+namespace SR
+{
+	struct Song;
+	struct RenderState;
+	class SoftwareCanvas;
+	class BitmapFont;
+	class WorkerPool;
+
+	/** What the view and exported images are cleared to */
+	const ColorValue BackgroundColor = 0xff303030;
+
+	/** Rows [top, top + height) of an export pass scrolled to yScroll */
+	struct ExportStrip
+	{
+		float yScroll;
+		int32 top;
+		int32 height;
+	};
+
+	/** Rows of the export image of a song, 0 if it is too short to have any */
+	int32 GetExportHeight(double duration, float timeRes);
+
+	/**
+	 *  Lays out the export image of a song as passes of passHeight rows,
+	 *  each cut into strips of at most stripHeight rows, and adds the strips
+	 *  in image order, top down. Returns the height of the image.
+	 */
+	int32 PlanExportStrips(double duration, float timeRes, int32 passHeight, int32 stripHeight, List<ExportStrip>& strips);
+
+	/** Everything an export draws with, for a PaletteQuantizer */
+	void GetExportColors(List<ColorValue>& colors);
+
+	struct ExportSettings
+	{
+		float timeResolution = 100;
+		int32 pitchShift = 0;
+		int32 width = 1280;
+		int32 passHeight = 720;
+		PngColorMode colorMode = PNGCOL_RGB;
+	};
+
+	/**
+	 *  Exports songs one after another on the calling thread, reusing its
+	 *  buffers between them. Where ExportSession spreads one export over all
+	 *  threads, many songs go faster with a SerialExporter per thread, which
+	 *  then share nothing but the font. The images are the same either way.
+	 */
+	class SerialExporter
+	{
+	public:
+		SerialExporter(const ExportSettings& settings, const BitmapFont* font);
+		~SerialExporter();
+
+		/** Writes the PNG and returns its height. A song without notes writes nothing and returns 0. */
+		int32 Export(const Song* song, const String& path);
+
+	private:
+		ExportSettings m_settings;
+
+		/** a whole pass, as this thread renders all of it anyway */
+		SoftwareCanvas* m_canvas;
+		RenderState* m_renderState;
+
+		/** without threads of its own, so deflate runs on the caller */
+		WorkerPool* m_encodePool;
+		PaletteQuantizer* m_quantizer = nullptr;
+
+		List<ExportStrip> m_strips;
+	};
+}
@@ -4,12 +4,12 @@
 
 namespace SR
 {
-	struct PngSaveContext { };
-
-	PngSaveContext* BeginStreamPng(int32 w, int32 h, FileOutStream& strm);
-	void StreamInPng(PngSaveContext* ctx, RenderTarget* rt, int32 startY, int32 height, bool removeAlpha);
-	void EndStreamPng(PngSaveContext* ctx);
-
-	void SavePng(RenderTarget* rt, FileOutStream& strm, bool removeAlpha);
+	/**
+	 *  Decodes a PNG of any color type and bit depth to 8-bit B, G, R, A
+	 *  pixels, the layout of FMT_A8R8G8B8, without a device. False if the
+	 *  stream does not hold a readable PNG.
+	 */
+	bool LoadPngPixels(Stream* strm, int32& width, int32& height, List<byte>& pixels);
+	/** Same as LoadPngPixels, decoding straight into a new texture. Null on failure. */
 	Texture* LoadPngTexture(RenderDevice* device, const ResourceLocation& rl);
 }
\ No newline at end of file
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "SRCommon.h"
+
+namespace SR
+{
+	struct IntervalRange
+	{
+		int32 first = 0;
+		int32 count = 0;
+	};
+
+	/**
+	 *  Finds the time intervals overlapping a window. Items are indexed as
+	 *  runs with ascending start times, and every run keeps its longest
+	 *  duration. A query is then one binary search per run, O(log n + k).
+	 */
+	class IntervalIndex
+	{
+	public:
+		void Clear() { m_runs.Clear(); }
+
+		/** Adds the items [first, first + count) as a run. Their starts must be ascending. */
+		void AddRun(int32 first, int32 count, double maxDuration);
+
+		/**
+		 *  Adds the index range of each run's items which can overlap [from, to]
+		 *  to result, in run order. Items are only selected by their start
+		 *  time, so a range can still contain items that ended before from.
+		 */
+		template <typename T>
+		void Query(const T* start, double from, double to, List<IntervalRange>& result) const;
+
+		int32 getRunCount() const { return m_runs.getCount(); }
+
+	private:
+		struct Run
+		{
+			int32 first;
+			int32 count;
+			double maxDuration;
+		};
+
+		/** Index of the first item in [first, end) starting at or after time */
+		template <typename T>
+		static int32 LowerBound(const T* start, int32 first, int32 end, double time);
+
+		/** Index of the first item in [first, end) starting after time */
+		template <typename T>
+		static int32 UpperBound(const T* start, int32 first, int32 end, double time);
+
+		List<Run> m_runs;
+	};
+
+	inline void IntervalIndex::AddRun(int32 first, int32 count, double maxDuration)
+	{
+		if (count > 0)
+		{
+			Run r;
+			r.first = first;
+			r.count = count;
+			r.maxDuration = maxDuration;
+			m_runs.Add(r);
+		}
+	}
+
+	template <typename T>
+	void IntervalIndex::Query(const T* start, double from, double to, List<IntervalRange>& result) const
+	{
+		for (const Run& r : m_runs)
+		{
+			int32 end = r.first + r.count;
+
+			int32 lo = LowerBound(start, r.first, end, from - r.maxDuration);
+			int32 hi = UpperBound(start, lo, end, to);
+
+			if (hi > lo)
+			{
+				IntervalRange range;
+				range.first = lo;
+				range.count = hi - lo;
+				result.Add(range);
+			}
+		}
+	}
+
+	template <typename T>
+	int32 IntervalIndex::LowerBound(const T* start, int32 first, int32 end, double time)
+	{
+		while (first < end)
+		{
+			int32 mid = first + (end - first) / 2;
+			if (start[mid] < time)
+				first = mid + 1;
+			else
+				end = mid;
+		}
+		return first;
+	}
+
+	template <typename T>
+	int32 IntervalIndex::UpperBound(const T* start, int32 first, int32 end, double time)
+	{
+		while (first < end)
+		{
+			int32 mid = first + (end - first) / 2;
+			if (start[mid] <= time)
+				first = mid + 1;
+			else
+				end = mid;
+		}
+		return first;
+	}
+}
@@ -0,0 +1,210 @@
+//
+// Filename:      midifile/include/MidiByteReader.h
+// Syntax:        C++11
+// vim:           ts=3 expandtab
+//
+// Description:   Bounds-checked cursor over an in-memory Standard MIDI
+//                File image (a memory-mapped file or a buffer read in one
+//                go).  Chunk headers, VLV values and events are decoded
+//                straight from the bytes, without going through an
+//                istream one character at a time.
+//
+
+#ifndef _MIDIBYTEREADER_H_INCLUDED
+#define _MIDIBYTEREADER_H_INCLUDED
+
+#include <stddef.h>
+
+typedef unsigned char  uchar;
+
+
+//////////////////////////////
+//
+// MidiRawEvent -- A MIDI message which still lives in the source buffer.
+//    The complete message is the command byte followed by "size" bytes
+//    starting at "data".  The command byte is kept separately because it
+//    is not present in the buffer for running-status messages.
+//    Sysex (0xf0/0xf7) data excludes the VLV length, matching the way
+//    MidiFile stores those messages.  Meta data begins with the meta type
+//    and includes the length bytes as written in the file.
+//
+
+struct MidiRawEvent {
+   uchar        command;
+   const uchar* data;
+   int          size;
+};
+
+
+class MidiByteReader {
+   public:
+      MidiByteReader(const uchar* data, size_t size)
+            : start(data), ptr(data), end(data + size) { }
+
+      size_t tell(void) const { return (size_t)(ptr - start); }
+      size_t remaining(void) const { return (size_t)(end - ptr); }
+      int    eof(void) const { return ptr >= end; }
+      const uchar* position(void) const { return ptr; }
+
+      int seek(size_t offset) {
+         if (offset > (size_t)(end - start)) {
+            return 0;
+         }
+         ptr = start + offset;
+         return 1;
+      }
+
+      int skip(size_t count) {
+         if (count > remaining()) {
+            return 0;
+         }
+         ptr += count;
+         return 1;
+      }
+
+      int readByte(uchar& value) {
+         if (ptr >= end) {
+            return 0;
+         }
+         value = *ptr++;
+         return 1;
+      }
+
+      // 2 and 4 byte integers are stored most significant byte first.
+      int read2Bytes(unsigned short& value) {
+         if (remaining() < 2) {
+            return 0;
+         }
+         value = (unsigned short)((ptr[0] << 8) | ptr[1]);
+         ptr += 2;
+         return 1;
+      }
+
+      int read4Bytes(unsigned int& value) {
+         if (remaining() < 4) {
+            return 0;
+         }
+         value = ((unsigned int)ptr[0] << 24) | ((unsigned int)ptr[1] << 16) |
+                 ((unsigned int)ptr[2] << 8)  |  (unsigned int)ptr[3];
+         ptr += 4;
+         return 1;
+      }
+
+      // Match a four character chunk ID such as "MThd" or "MTrk".
+      int matchTag(const char* tag) {
+         if (remaining() < 4) {
+            return 0;
+         }
+         if (ptr[0] != (uchar)tag[0] || ptr[1] != (uchar)tag[1] ||
+             ptr[2] != (uchar)tag[2] || ptr[3] != (uchar)tag[3]) {
+            return 0;
+         }
+         ptr += 4;
+         return 1;
+      }
+
+      // VLV values are limited to 4 bytes (28 bits) by the SMF spec; a fifth
+      // byte is accepted like MidiFile::readVLValue() does.
+      int readVLValue(unsigned int& value) {
+         value = 0;
+         for (int i=0; i<5; i++) {
+            if (ptr >= end) {
+               return 0;
+            }
+            uchar b = *ptr++;
+            value = (value << 7) | (b & 0x7f);
+            if (b < 0x80) {
+               return 1;
+            }
+         }
+         return 0;
+      }
+
+      int readEvent(uchar& runningCommand, MidiRawEvent& event);
+
+   private:
+      const uchar* start;
+      const uchar* ptr;
+      const uchar* end;
+};
+
+
+
+//////////////////////////////
+//
+// MidiByteReader::readEvent -- Decode the MIDI message at the current
+//    position (the delta time must already have been read).  Returns 0
+//    on malformed or truncated data, otherwise 1.  Follows the same rules
+//    as MidiFile::extractMidiData().
+//
+
+inline int MidiByteReader::readEvent(uchar& runningCommand,
+      MidiRawEvent& event) {
+   if (ptr >= end) {
+      return 0;
+   }
+
+   if (*ptr < 0x80) {
+      if (runningCommand == 0) {
+         // running command with no previous command
+         return 0;
+      }
+      if (runningCommand >= 0xf0) {
+         // running status not permitted with meta and sysex
+         return 0;
+      }
+   } else {
+      runningCommand = *ptr++;
+   }
+
+   event.command = runningCommand;
+   event.data    = ptr;
+   event.size    = 0;
+
+   unsigned int length;
+   switch (runningCommand & 0xf0) {
+      case 0x80:        // note off (2 bytes)
+      case 0x90:        // note on (2 bytes)
+      case 0xA0:        // aftertouch (2 bytes)
+      case 0xB0:        // cont. controller (2 bytes)
+      case 0xE0:        // pitch wheel (2 bytes)
+         event.size = 2;
+         break;
+      case 0xC0:        // patch change (1 byte)
+      case 0xD0:        // channel pressure (1 byte)
+         event.size = 1;
+         break;
+      case 0xF0:
+         switch (runningCommand) {
+            case 0xff:                 // meta event: type, VLV length, data
+               if (!skip(1) || !readVLValue(length) || length > remaining()) {
+                  return 0;
+               }
+               event.size = (int)(ptr - event.data) + (int)length;
+               ptr = event.data;
+               break;
+            case 0xf7:                 // raw bytes
+            case 0xf0:                 // system exclusive
+               if (!readVLValue(length) || length > remaining()) {
+                  return 0;
+               }
+               event.data = ptr;
+               event.size = (int)length;
+               break;
+            // other "F" MIDI commands carry no data here.
+         }
+         break;
+   }
+
+   if (event.size < 0 || (size_t)event.size > remaining()) {
+      return 0;
+   }
+   ptr += event.size;
+   return 1;
+}
+
+
+#endif /* _MIDIBYTEREADER_H_INCLUDED */
+
+
+
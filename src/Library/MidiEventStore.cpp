@@ -0,0 +1,541 @@
+//
+// Filename:      midifile/src/MidiEventStore.cpp
+// Syntax:        C++11
+// vim:           ts=3 expandtab
+//
+// Description:   Compact read-only storage for the events of a MIDI file.
+//
+
+#include "MidiEventStore.h"
+#include "MidiByteReader.h"
+
+#include <string.h>
+#include <iostream>
+
+using namespace std;
+
+
+//////////////////////////////
+//
+// MidiEventRef::getTempoSeconds -- Returns the number of seconds per
+//      quarter note.  Returns -1.0 if the event is not a tempo meta message.
+//
+
+double MidiEventRef::getTempoSeconds(void) const {
+   int microseconds = getTempoMicroseconds();
+   if (microseconds < 0) {
+      return -1.0;
+   } else {
+      return (double)microseconds / 1000000.0;
+   }
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventRef::getTempoBPM -- Returns the tempo in terms of beats per minute.
+//
+
+double MidiEventRef::getTempoBPM(void) const {
+   int microseconds = getTempoMicroseconds();
+   if (microseconds < 0) {
+      return -1.0;
+   }
+   return 60000000.0 / (double)microseconds;
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventRef::getTempoTPS -- Returns the tempo in terms of ticks per seconds.
+//
+
+double MidiEventRef::getTempoTPS(int tpq) const {
+   int microseconds = getTempoMicroseconds();
+   if (microseconds < 0) {
+      return -1.0;
+   } else {
+      return tpq * 1000000.0 / (double)microseconds;
+   }
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventRef::getTempoSPT -- Returns the tempo in terms of seconds per tick.
+//
+
+double MidiEventRef::getTempoSPT(int tpq) const {
+   int microseconds = getTempoMicroseconds();
+   if (microseconds < 0) {
+      return -1.0;
+   } else {
+      return (double)microseconds / 1000000.0 / tpq;
+   }
+}
+
+
+
+//////////////////////////////
+//
+// MidiReadFilter::keepsTrack -- Returns 1 if the track should be decoded.
+//
+
+int MidiReadFilter::keepsTrack(int aTrack) const {
+   if (aTrack == 0 || tracks.empty()) {
+      return 1;
+   }
+   for (int i=0; i<(int)tracks.size(); i++) {
+      if (tracks[i] == aTrack) {
+         return 1;
+      }
+   }
+   return 0;
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventStore::MidiEventStore -- Constructor.
+//
+
+MidiEventStore::MidiEventStore(void) {
+   ticksPerQuarterNote = 48;
+   rwstatus = 1;
+   trackStart.push_back(0);
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventStore::~MidiEventStore -- Deconstructor.
+//
+
+MidiEventStore::~MidiEventStore() {
+   clear();
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventStore::clear -- Remove all events.
+//
+
+void MidiEventStore::clear(void) {
+   records.clear();
+   arena.clear();
+   trackStart.clear();
+   trackStart.push_back(0);
+}
+
+
+
+//////////////////////////////
+//
+// estimateRecords -- The number of records to reserve for a kept track
+//    of the given length.  Note data with running status takes about
+//    three bytes per event, which is also close to the fewest, so this
+//    is near for tracks of notes and high for others.  When the filter
+//    leaves out channels there is no telling how many events remain, so
+//    nothing is reserved and the records grow as they are read.
+//
+
+static size_t estimateRecords(size_t length, const MidiReadFilter* filter) {
+   if (filter != NULL && filter->channels != 0xffff) {
+      return 0;
+   }
+   return length / 3;
+}
+
+
+
+//////////////////////////////
+//
+// readTrackEvents -- Decode one track, from the first delta time after
+//    its MTrk header up to and including its end-of-track message, and
+//    append the events to records and arena.  Events are dropped instead
+//    when "keep" is 0 or when the filter leaves out their channel.
+//    Returns 0 on malformed or truncated data, otherwise 1.
+//
+
+static int readTrackEvents(MidiByteReader& reader, int keep,
+      const MidiReadFilter* filter, vector<MidiEventRecord>& records,
+      vector<uchar>& arena) {
+   uchar runningCommand = 0;
+   MidiRawEvent raw;
+   MidiEventRecord record;
+   unsigned int longdata;
+   int absticks = 0;
+
+   while (1) {
+      if (!reader.readVLValue(longdata) ||
+            !reader.readEvent(runningCommand, raw)) {
+         return 0;
+      }
+      absticks += (int)longdata;
+
+      if (keep && ((raw.command >= 0xf0) || (filter == NULL) ||
+            filter->keepsChannel(raw.command & 0x0f))) {
+         record.tick    = absticks;
+         record.size    = raw.size + 1;
+         record.seconds = 0.0;
+         record.offset  = 0;
+         record.bytes[0] = raw.command;
+         int inlined = raw.size < 3 ? raw.size : 3;
+         memcpy(record.bytes + 1, raw.data, inlined);
+         memset(record.bytes + 1 + inlined, 0, 3 - inlined);
+
+         if (record.size > 4) {
+            record.offset = (unsigned int)arena.size();
+            arena.push_back(raw.command);
+            arena.insert(arena.end(), raw.data, raw.data + raw.size);
+         }
+         records.push_back(record);
+      }
+
+      if (raw.command == 0xff && raw.size > 0 && raw.data[0] == 0x2f) {
+         // end of track message
+         return 1;
+      }
+   }
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventStore::read -- Parse a Standard MIDI File held in memory.  The
+//    data is not referenced after this function returns.  Returns 1 on
+//    success and 0 if the file could not be parsed.  Event times are in
+//    absolute ticks; call doTimeAnalysis() to fill in the seconds.
+//    An optional filter leaves out tracks and channels.  Given a
+//    parallelFor, the tracks are decoded on several threads, see
+//    readParallel().  The result is the same either way.
+//
+
+int MidiEventStore::read(const uchar* data, size_t size,
+      const MidiReadFilter* filter, const MidiParallelFor& parallelFor) {
+   clear();
+   rwstatus = 0;
+
+   MidiByteReader reader(data, size);
+   unsigned int   longdata;
+   unsigned short shortdata;
+   unsigned short type;
+   unsigned short tracks;
+
+   if (!reader.matchTag("MThd") || !reader.read4Bytes(longdata) ||
+         longdata != 6) {
+      cerr << "Error: not a MIDI 1.0 Standard MIDI file" << endl;
+      return rwstatus;
+   }
+   if (!reader.read2Bytes(type) || !reader.read2Bytes(tracks) ||
+         !reader.read2Bytes(shortdata)) {
+      cerr << "Error: unexpected end of file." << endl;
+      return rwstatus;
+   }
+   if ((type != 0 && type != 1) || (type == 0 && tracks != 1)) {
+      cerr << "Error: cannot handle a type-" << type << " MIDI file with "
+           << tracks << " tracks" << endl;
+      return rwstatus;
+   }
+   // SMPTE divisions are kept as-is, the same as MidiFile does.
+   ticksPerQuarterNote = shortdata;
+
+   if (parallelFor && (tracks > 1) &&
+         readParallel(data, size, reader.tell(), tracks, filter, parallelFor)) {
+      rwstatus = 1;
+      return rwstatus;
+   }
+
+   // Reserve for the tracks that are kept, from the lengths in their
+   // headers.  A wrong length only makes the estimate wrong, as the
+   // tracks are read below without relying on it.
+   MidiByteReader scan(data, size);
+   scan.seek(reader.tell());
+   size_t estimate = 0;
+   for (int i=0; i<tracks; i++) {
+      if (!scan.matchTag("MTrk") || !scan.read4Bytes(longdata) ||
+            (longdata > scan.remaining())) {
+         break;
+      }
+      if (filter == NULL || filter->keepsTrack(i)) {
+         estimate += estimateRecords(longdata, filter);
+      }
+      scan.seek(scan.tell() + longdata);
+   }
+   records.reserve(estimate);
+
+   int keep;
+
+   for (int i=0; i<tracks; i++) {
+      if (!reader.matchTag("MTrk") || !reader.read4Bytes(longdata)) {
+         cerr << "Error: expecting 'MTrk' at start of track " << i << endl;
+         clear();
+         return rwstatus;
+      }
+
+      keep = filter == NULL || filter->keepsTrack(i);
+      if (!keep && longdata <= reader.remaining()) {
+         // jump over the track if its length ends where the next one
+         // starts, otherwise it is decoded below without storing events.
+         size_t next = reader.tell() + longdata;
+         if ((i == tracks - 1) ||
+               ((size - next >= 4) && (memcmp(data + next, "MTrk", 4) == 0))) {
+            reader.seek(next);
+            trackStart.push_back((int)records.size());
+            continue;
+         }
+      }
+
+      if (!readTrackEvents(reader, keep, filter, records, arena)) {
+         cerr << "Error: unexpected end of file or bad MIDI data in track "
+              << i << "." << endl;
+         clear();
+         return rwstatus;
+      }
+      trackStart.push_back((int)records.size());
+   }
+
+   rwstatus = 1;
+   return rwstatus;
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventStore::readParallel -- Find every MTrk chunk from the lengths
+//    in their headers, then decode the tracks at the same time, each into
+//    records of its own, and join them in track order.  This only
+//    succeeds when the file reads the same as it would one track after
+//    another: every length must lead to the next MTrk header, every
+//    track but the last must end exactly there, and no track may fail
+//    to decode.  Otherwise nothing is stored and 0 is returned, so that
+//    read() goes through the file again in order and reports the error
+//    (or the odd layout) exactly as it always has.
+//
+
+int MidiEventStore::readParallel(const uchar* data, size_t size,
+      size_t offset, int tracks, const MidiReadFilter* filter,
+      const MidiParallelFor& parallelFor) {
+   struct TrackChunk {
+      size_t start;                       // first byte after the header
+      size_t end;                         // start + length from the header
+      int    status;
+      vector<MidiEventRecord> records;
+      vector<uchar> arena;
+   };
+
+   MidiByteReader reader(data, size);
+   reader.seek(offset);
+   unsigned int longdata;
+
+   vector<TrackChunk> chunks(tracks);
+   for (int i=0; i<tracks; i++) {
+      if (!reader.matchTag("MTrk") || !reader.read4Bytes(longdata) ||
+            (longdata > reader.remaining())) {
+         return 0;
+      }
+      chunks[i].start = reader.tell();
+      chunks[i].end = chunks[i].start + longdata;
+      reader.seek(chunks[i].end);
+   }
+
+   parallelFor(tracks, [&](int i) {
+      TrackChunk& chunk = chunks[i];
+      if (filter != NULL && !filter->keepsTrack(i)) {
+         chunk.status = 1;
+         return;
+      }
+
+      // a reader over the whole file, as the track may run past its
+      // length, in which case read() takes the file in order instead.
+      MidiByteReader trackReader(data, size);
+      trackReader.seek(chunk.start);
+      chunk.records.reserve(estimateRecords(chunk.end - chunk.start, filter));
+      chunk.status = readTrackEvents(trackReader, 1, filter, chunk.records,
+            chunk.arena);
+      if (chunk.status && (i < tracks - 1) &&
+            (trackReader.tell() != chunk.end)) {
+         chunk.status = 0;
+      }
+   });
+
+   // the tracks are copied to their places in parallel as well
+   vector<size_t> recordStart(tracks + 1, 0);
+   vector<size_t> arenaStart(tracks + 1, 0);
+   for (int i=0; i<tracks; i++) {
+      if (!chunks[i].status) {
+         return 0;
+      }
+      recordStart[i+1] = recordStart[i] + chunks[i].records.size();
+      arenaStart[i+1] = arenaStart[i] + chunks[i].arena.size();
+   }
+
+   records.resize(recordStart[tracks]);
+   arena.resize(arenaStart[tracks]);
+
+   parallelFor(tracks, [&](int i) {
+      TrackChunk& chunk = chunks[i];
+      MidiEventRecord* target = records.data() + recordStart[i];
+      unsigned int base = (unsigned int)arenaStart[i];
+      for (size_t j=0; j<chunk.records.size(); j++) {
+         target[j] = chunk.records[j];
+         if (target[j].size > 4) {
+            target[j].offset += base;
+         }
+      }
+      if (!chunk.arena.empty()) {
+         memcpy(arena.data() + base, chunk.arena.data(), chunk.arena.size());
+      }
+      vector<MidiEventRecord>().swap(chunk.records);
+      vector<uchar>().swap(chunk.arena);
+   });
+
+   for (int i=0; i<tracks; i++) {
+      trackStart.push_back((int)recordStart[i+1]);
+   }
+
+   return 1;
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventStore::status -- Returns 1 if the last read was successful.
+//
+
+int MidiEventStore::status(void) const {
+   return rwstatus;
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventStore::getTrackCount -- Returns the number of tracks.
+//
+
+int MidiEventStore::getTrackCount(void) const {
+   return (int)trackStart.size() - 1;
+}
+
+
+int MidiEventStore::size(void) const {
+   return getTrackCount();
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventStore::getTotalEventCount -- Returns the number of events in
+//    all tracks.
+//
+
+int MidiEventStore::getTotalEventCount(void) const {
+   return (int)records.size();
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventStore::getTicksPerQuarterNote --
+//
+
+int MidiEventStore::getTicksPerQuarterNote(void) const {
+   return ticksPerQuarterNote;
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventStore::getTotalTimeInTicks -- Returns the absolute tick value
+//    for the latest event in any track.
+//
+
+int MidiEventStore::getTotalTimeInTicks(void) const {
+   int output = 0;
+   for (int i=0; i<getTrackCount(); i++) {
+      if (getNumEvents(i) > 0 && records[trackStart[i+1]-1].tick > output) {
+         output = records[trackStart[i+1]-1].tick;
+      }
+   }
+   return output;
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventStore::getTotalTimeInSeconds -- Returns the time of the
+//    latest event in any track.  doTimeAnalysis() must have been called.
+//
+
+double MidiEventStore::getTotalTimeInSeconds(void) const {
+   double output = 0.0;
+   for (int i=0; i<getTrackCount(); i++) {
+      if (getNumEvents(i) > 0 && records[trackStart[i+1]-1].seconds > output) {
+         output = records[trackStart[i+1]-1].seconds;
+      }
+   }
+   return output;
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventStore::doTimeAnalysis -- Build the tempo map and fill in the
+//    time in seconds of every event.
+//
+
+void MidiEventStore::doTimeAnalysis(void) {
+   tempomap.build(*this);
+
+   for (int i=0; i<getTrackCount(); i++) {
+      int segment = 0;
+      for (int j=trackStart[i]; j<trackStart[i+1]; j++) {
+         MidiEventRecord& record = records[j];
+         record.seconds = tempomap.getSecondsAtTick(record.tick, segment);
+      }
+   }
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventStore::getTempoMap -- Returns the tempo segments found by
+//    doTimeAnalysis().
+//
+
+const MidiTempoMap& MidiEventStore::getTempoMap(void) const {
+   return tempomap;
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventStore::getMemoryUsage -- Returns the number of bytes held by
+//    the event storage.
+//
+
+size_t MidiEventStore::getMemoryUsage(void) const {
+   return records.capacity() * sizeof(MidiEventRecord) +
+         trackStart.capacity() * sizeof(int) + arena.capacity();
+}
+
+
+
@@ -0,0 +1,246 @@
+//
+// Filename:      midifile/include/MidiEventStore.h
+// Syntax:        C++11
+// vim:           ts=3 expandtab
+//
+// Description:   Compact read-only storage for the events of a MIDI file.
+//                Every event is a fixed-size record in one array (track
+//                after track) with the first message bytes stored inline.
+//                Longer messages (meta and sysex) are kept in one byte
+//                arena shared by the whole file, so loading does not
+//                allocate anything per event.
+//
+
+#ifndef _MIDIEVENTSTORE_H_INCLUDED
+#define _MIDIEVENTSTORE_H_INCLUDED
+
+#include "MidiTempoMap.h"
+
+#include <vector>
+#include <functional>
+#include <stddef.h>
+
+using namespace std;
+
+typedef unsigned char  uchar;
+
+
+//////////////////////////////
+//
+// MidiEventRecord -- 24 bytes per event.  Messages of up to four bytes
+//    are stored in "bytes"; longer ones are stored complete in the arena
+//    at "offset", and "bytes" still holds their first four bytes.
+//
+
+struct MidiEventRecord {
+   int          tick;
+   int          size;      // message length, including the command byte
+   double       seconds;
+   unsigned int offset;
+   uchar        bytes[4];
+};
+
+
+
+//////////////////////////////
+//
+// MidiEventRef -- Read-only view of a stored event which has the same
+//    accessors as MidiEvent, so code iterating a MidiFile can iterate a
+//    MidiEventStore with few changes.
+//
+
+class MidiEventRef {
+   public:
+      MidiEventRef(const MidiEventRecord& record, const uchar* message,
+            int atrack)
+            : tick(record.tick), track(atrack), seconds(record.seconds),
+              bytes(message), length(record.size) { }
+
+      int    size                 (void) const { return length; }
+      int    getSize              (void) const { return length; }
+      const uchar* data           (void) const { return bytes; }
+      uchar  operator[]           (int index) const { return bytes[index]; }
+
+      int    getP0                (void) const {
+         return length < 1 ? -1 : bytes[0]; }
+      int    getP1                (void) const {
+         return length < 2 ? -1 : bytes[1]; }
+      int    getP2                (void) const {
+         return length < 3 ? -1 : bytes[2]; }
+      int    getP3                (void) const {
+         return length < 4 ? -1 : bytes[3]; }
+
+      int    getCommandByte       (void) const { return getP0(); }
+      int    getCommandNibble     (void) const {
+         return length < 1 ? -1 : bytes[0] & 0xf0; }
+      int    getChannelNibble     (void) const {
+         return length < 1 ? -1 : bytes[0] & 0x0f; }
+      int    getChannel           (void) const { return getChannelNibble(); }
+
+      int    isNoteOff            (void) const {
+         return (length == 3) && (((bytes[0] & 0xf0) == 0x80) ||
+               (((bytes[0] & 0xf0) == 0x90) && (bytes[2] == 0))); }
+      int    isNoteOn             (void) const {
+         return (length == 3) && ((bytes[0] & 0xf0) == 0x90) &&
+               (bytes[2] != 0); }
+      int    isNote               (void) const {
+         return isNoteOn() || isNoteOff(); }
+      int    isAftertouch         (void) const {
+         return (length == 3) && ((bytes[0] & 0xf0) == 0xa0); }
+      int    isController         (void) const {
+         return (length == 3) && ((bytes[0] & 0xf0) == 0xb0); }
+      int    isTimbre             (void) const {
+         return (length == 2) && ((bytes[0] & 0xf0) == 0xc0); }
+      int    isPatchChange        (void) const { return isTimbre(); }
+      int    isPressure           (void) const {
+         return (length == 2) && ((bytes[0] & 0xf0) == 0xd0); }
+      int    isPitchbend          (void) const {
+         return (length == 3) && ((bytes[0] & 0xf0) == 0xe0); }
+
+      int    isMeta               (void) const {
+         return (length >= 3) && (bytes[0] == 0xff); }
+      int    isMetaMessage        (void) const { return isMeta(); }
+      int    getMetaType          (void) const {
+         return isMeta() ? (int)bytes[1] : -1; }
+      int    isTempo              (void) const {
+         return isMeta() && (bytes[1] == 0x51) && (length == 6); }
+      int    isEndOfTrack         (void) const {
+         return getMetaType() == 0x2f; }
+
+      int    getKeyNumber         (void) const {
+         return (isNote() || isAftertouch()) ? (int)bytes[1] : -1; }
+      int    getVelocity          (void) const {
+         return isNote() ? (int)bytes[2] : -1; }
+
+      int    getTempoMicro        (void) const {
+         return isTempo() ? (bytes[3] << 16) + (bytes[4] << 8) + bytes[5]
+               : -1; }
+      int    getTempoMicroseconds (void) const { return getTempoMicro(); }
+      double getTempoSeconds      (void) const;
+      double getTempoBPM          (void) const;
+      double getTempoTPS          (int tpq) const;
+      double getTempoSPT          (int tpq) const;
+
+      int    tick;
+      int    track;
+      double seconds;
+
+   private:
+      const uchar* bytes;
+      int          length;
+};
+
+
+
+//////////////////////////////
+//
+// MidiReadFilter -- Limits what MidiEventStore::read decodes.  Unwanted
+//    tracks are passed over using the length in their MTrk header and are
+//    left in the store without events, so track numbers do not change.
+//    A length which does not lead to the next MTrk header (or to the end
+//    of the file after the last track) is not trusted, and the track is
+//    decoded to find its end.  Channel messages on unwanted channels are
+//    dropped, meta and sysex messages are always kept.  Track 0 is always
+//    decoded, since type-1 files keep the tempo map there.
+//
+
+struct MidiReadFilter {
+   MidiReadFilter(void) : channels(0xffff) { }
+
+   int keepsTrack   (int aTrack) const;
+   int keepsChannel (int aChannel) const { return (channels >> aChannel) & 1; }
+
+   vector<int>  tracks;     // tracks to decode, all of them if empty
+   unsigned int channels;   // bit n keeps channel n, counting from 0
+};
+
+
+
+//////////////////////////////
+//
+// MidiParallelFor -- Calls body(i) for every i in [0, count), possibly on
+//    several threads at once, and returns when all calls are done.
+//
+
+typedef function<void(int count, const function<void(int)>& body)>
+      MidiParallelFor;
+
+
+
+class MidiEventStore {
+   public:
+                     MidiEventStore          (void);
+                    ~MidiEventStore          ();
+
+      // reading from an in-memory Standard MIDI File:
+      int            read                    (const uchar* data, size_t size,
+                                              const MidiReadFilter* filter = NULL,
+                                              const MidiParallelFor& parallelFor =
+                                                 MidiParallelFor());
+      int            status                  (void) const;
+      void           clear                   (void);
+
+      int            getTrackCount           (void) const;
+      int            size                    (void) const;
+      int            getNumEvents            (int aTrack) const;
+      int            getTotalEventCount      (void) const;
+      MidiEventRef   getEvent                (int aTrack, int anIndex) const;
+
+      // direct access to the records of a track and their message bytes:
+      const MidiEventRecord* getRecords      (int aTrack) const;
+      const uchar*   getMessage              (const MidiEventRecord& record)
+                                                const;
+
+      int            getTicksPerQuarterNote  (void) const;
+      int            getTotalTimeInTicks     (void) const;
+      double         getTotalTimeInSeconds   (void) const;
+      void           doTimeAnalysis          (void);
+      const MidiTempoMap& getTempoMap        (void) const;
+
+      size_t         getMemoryUsage          (void) const;
+
+   private:
+      int            readParallel            (const uchar* data, size_t size,
+                                              size_t offset, int tracks,
+                                              const MidiReadFilter* filter,
+                                              const MidiParallelFor& parallelFor);
+
+      vector<MidiEventRecord> records;        // all events, track by track
+      vector<int>             trackStart;     // first record of each track
+      vector<uchar>           arena;          // messages longer than 4 bytes
+      MidiTempoMap            tempomap;
+      int                     ticksPerQuarterNote;
+      int                     rwstatus;
+};
+
+
+
+// The accessors used for iterating are inline, since they are called
+// once per event.
+
+inline int MidiEventStore::getNumEvents(int aTrack) const {
+   return trackStart[aTrack + 1] - trackStart[aTrack];
+}
+
+
+inline const MidiEventRecord* MidiEventStore::getRecords(int aTrack) const {
+   return records.data() + trackStart[aTrack];
+}
+
+
+inline const uchar* MidiEventStore::getMessage(
+      const MidiEventRecord& record) const {
+   return record.size > 4 ? arena.data() + record.offset : record.bytes;
+}
+
+
+inline MidiEventRef MidiEventStore::getEvent(int aTrack, int anIndex) const {
+   const MidiEventRecord& record = records[trackStart[aTrack] + anIndex];
+   return MidiEventRef(record, getMessage(record), aTrack);
+}
+
+
+#endif /* _MIDIEVENTSTORE_H_INCLUDED */
+
+
+
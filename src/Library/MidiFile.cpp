@@ -30,6 +30,8 @@
 
 #include "MidiFile.h"
 #include "Binasc.h"
+#include "MidiByteReader.h"
+#include "MidiTempoMap.h"
 
 #include <string.h>
 #include <iostream>
@@ -56,7 +58,6 @@ MidiFile::MidiFile(void) {
    events[0] = new MidiEventList;
    readFileName.resize(1);
    readFileName[0] = '\0';
-   timemap.clear();
    timemapvalid = 0;
    rwstatus = 1;
 }
@@ -72,7 +73,6 @@ MidiFile::MidiFile(const char* filename) {
    readFileName.resize(1);
    readFileName[0] = '\0';
    read(filename);
-   timemap.clear();
    timemapvalid = 0;
    rwstatus = 1;
 }
@@ -89,7 +89,6 @@ MidiFile::MidiFile(const string& filename) {
    readFileName.resize(1);
    readFileName[0] = '\0';
    read(filename);
-   timemap.clear();
    timemapvalid = 0;
    rwstatus = 1;
 }
@@ -105,7 +104,6 @@ MidiFile::MidiFile(istream& input) {
    readFileName.resize(1);
    readFileName[0] = '\0';
    read(input);
-   timemap.clear();
    timemapvalid = 0;
    rwstatus = 1;
 }
@@ -132,7 +130,7 @@ MidiFile::MidiFile(const MidiFile& other) {
    readFileName = other.readFileName;
 
    timemapvalid = other.timemapvalid;
-   timemap = other.timemap;
+   tempomap = other.tempomap;
    rwstatus = other.rwstatus;
 }
 
@@ -155,7 +153,7 @@ MidiFile::MidiFile(MidiFile&& other) {
    readFileName = other.readFileName;
 
    timemapvalid = other.timemapvalid;
-   timemap = other.timemap;
+   tempomap = other.tempomap;
    rwstatus = other.rwstatus;
 }
 
@@ -176,7 +174,6 @@ MidiFile::~MidiFile() {
    }
    events.resize(0);
    rwstatus = 0;
-   timemap.clear();
    timemapvalid = 0;
 }
 
@@ -206,7 +203,23 @@ int MidiFile::read(const char* filename) {
       return 0;
    }
 
-   rwstatus = MidiFile::read(input);
+   // The whole file is loaded at once and decoded from memory, which
+   // skips the per-byte istream calls of read(istream&).
+   input.seekg(0, ios::end);
+   streamoff length = input.tellg();
+   input.seekg(0, ios::beg);
+   if (length <= 0) {
+      rwstatus = MidiFile::read(input);
+      return rwstatus;
+   }
+
+   vector<uchar> buffer((size_t)length);
+   if (!input.read((char*)buffer.data(), length)) {
+      rwstatus = 0;
+      return rwstatus;
+   }
+
+   rwstatus = MidiFile::read(buffer.data(), buffer.size());
    return rwstatus;
 }
 
@@ -217,19 +230,7 @@ int MidiFile::read(const char* filename) {
 
 
 int MidiFile::read(const string& filename) {
-   timemapvalid = 0;
-   setFilename(filename);
-   rwstatus = 1;
-
-   fstream input;
-   input.open(filename.data(), ios::binary | ios::in);
-
-   if (!input.is_open()) {
-      return 0;
-   }
-
-   rwstatus = MidiFile::read(input);
-   return rwstatus;
+   return MidiFile::read(filename.c_str());
 }
 
 
@@ -353,41 +354,11 @@ int MidiFile::read(istream& input) {
    } else {
       tracks = shortdata;
    }
-   clear();
-   if (events[0] != NULL) {
-      delete events[0];
-   }
-   events.resize(tracks);
-   for (int z=0; z<tracks; z++) {
-      events[z] = new MidiEventList;
-      events[z]->reserve(10000);   // Initialize with 10,000 event storage.
-      events[z]->clear();
-   }
+   initializeTracks(tracks);
 
    // Header parameter #3: Ticks per quarter note
    shortdata = MidiFile::readLittleEndian2Bytes(input);
-   if (shortdata >= 0x8000) {
-      int framespersecond = ((!(shortdata >> 8))+1) & 0x00ff;
-      int resolution      = shortdata & 0x00ff;
-      switch (framespersecond) {
-         case 232:  framespersecond = 24; break;
-         case 231:  framespersecond = 25; break;
-         case 227:  framespersecond = 29; break;
-         case 226:  framespersecond = 30; break;
-         default:
-               cerr << "Warning: unknown FPS: " << framespersecond << endl;
-               framespersecond = 255 - framespersecond + 1;
-               cerr << "Setting FPS to " << framespersecond << endl;
-      }
-      // actually ticks per second (except for frame=29 (drop frame)):
-      ticksPerQuarterNote = shortdata;
-
-      cerr << "SMPTE ticks: " << ticksPerQuarterNote << " ticks/sec" << endl;
-      cerr << "SMPTE frames per second: " << framespersecond << endl;
-      cerr << "SMPTE frame resolution per frame: " << resolution << endl;
-   }  else {
-      ticksPerQuarterNote = shortdata;
-   }
+   setDivision(shortdata);
 
 
    //////////////////////////////////////////////////
@@ -525,6 +496,186 @@ int MidiFile::read(istream& input) {
 }
 
 
+//
+// In-memory version of read().  The data can be a memory-mapped file or
+// a buffer holding the whole file.  Chunks, delta times and running status
+// are decoded directly from the bytes with bounds checking.  Binasc content
+// is converted through the istream version.
+//
+
+int MidiFile::read(const uchar* data, size_t size) {
+   rwstatus = 1;
+   timemapvalid = 0;
+   if ((size == 0) || (data[0] != 'M')) {
+      string text((const char*)data, size);
+      stringstream input(text);
+      rwstatus = read(input);
+      return rwstatus;
+   }
+
+   const char* filename = getFilename();
+   MidiByteReader reader(data, size);
+   unsigned int   longdata;
+   unsigned short shortdata;
+
+   if (!reader.matchTag("MThd")) {
+      cerr << "File " << filename << " is not a MIDI file" << endl;
+      cerr << "Expecting 'MThd' at start of file" << endl;
+      rwstatus = 0; return rwstatus;
+   }
+
+   if (!reader.read4Bytes(longdata)) {
+      cerr << "In file " << filename << ": unexpected end of file." << endl;
+      rwstatus = 0; return rwstatus;
+   }
+   if (longdata != 6) {
+      cerr << "File " << filename
+           << " is not a MIDI 1.0 Standard MIDI file." << endl;
+      cerr << "The header size is " << longdata << " bytes." << endl;
+      rwstatus = 0; return rwstatus;
+   }
+
+   // Header parameter #1: format type
+   if (!reader.read2Bytes(shortdata)) {
+      cerr << "In file " << filename << ": unexpected end of file." << endl;
+      rwstatus = 0; return rwstatus;
+   }
+   int type = shortdata;
+   if (type != 0 && type != 1) {
+      cerr << "Error: cannot handle a type-" << shortdata
+           << " MIDI file" << endl;
+      rwstatus = 0; return rwstatus;
+   }
+
+   // Header parameter #2: track count
+   if (!reader.read2Bytes(shortdata)) {
+      cerr << "In file " << filename << ": unexpected end of file." << endl;
+      rwstatus = 0; return rwstatus;
+   }
+   if (type == 0 && shortdata != 1) {
+      cerr << "Error: Type 0 MIDI file can only contain one track" << endl;
+      cerr << "Instead track count is: " << shortdata << endl;
+      rwstatus = 0; return rwstatus;
+   }
+   int tracks = shortdata;
+
+   // Header parameter #3: Ticks per quarter note
+   if (!reader.read2Bytes(shortdata)) {
+      cerr << "In file " << filename << ": unexpected end of file." << endl;
+      rwstatus = 0; return rwstatus;
+   }
+   initializeTracks(tracks);
+   setDivision(shortdata);
+
+   uchar runningCommand;
+   MidiRawEvent raw;
+   int absticks;
+
+   for (int i=0; i<tracks; i++) {
+      runningCommand = 0;
+
+      if (!reader.matchTag("MTrk")) {
+         cerr << "File " << filename << " is not a MIDI file" << endl;
+         cerr << "Expecting 'MTrk' at start of track " << i << endl;
+         rwstatus = 0; return rwstatus;
+      }
+
+      // The chunk size is only used as an allocation hint, since the track
+      // must end with an end-of-track meta message anyway (see read(istream)).
+      if (!reader.read4Bytes(longdata)) {
+         cerr << "In file " << filename << ": unexpected end of file." << endl;
+         rwstatus = 0; return rwstatus;
+      }
+      size_t hint = longdata < reader.remaining() ? longdata : reader.remaining();
+      events[i]->reserve((int)(hint / 3));
+
+      absticks = 0;
+      while (1) {
+         if (!reader.readVLValue(longdata) ||
+               !reader.readEvent(runningCommand, raw)) {
+            cerr << "In file " << filename << ": unexpected end of file "
+                 << "or bad MIDI data in track " << i << "." << endl;
+            rwstatus = 0; return rwstatus;
+         }
+         absticks += (int)longdata;
+
+         MidiEvent* event = new MidiEvent;
+         event->resize(raw.size + 1);
+         (*event)[0] = raw.command;
+         if (raw.size > 0) {
+            memcpy(event->data() + 1, raw.data, raw.size);
+         }
+         event->tick  = absticks;
+         event->track = i;
+         events[i]->push_back_no_copy(event);
+
+         if (raw.command == 0xff && raw.size > 0 && raw.data[0] == 0x2f) {
+            // end of track message
+            break;
+         }
+      }
+   }
+
+   theTimeState = TIME_STATE_ABSOLUTE;
+   markSequence();
+   return 1;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::initializeTracks -- Discard the current contents and allocate
+//    empty event lists for the given number of tracks.
+//
+
+void MidiFile::initializeTracks(int count) {
+   clear();
+   if (events[0] != NULL) {
+      delete events[0];
+   }
+   events.resize(count);
+   for (int z=0; z<count; z++) {
+      events[z] = new MidiEventList;
+      events[z]->reserve(10000);   // Initialize with 10,000 event storage.
+      events[z]->clear();
+   }
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::setDivision -- Interpret the time division field of the
+//    MIDI header.
+//
+
+void MidiFile::setDivision(int division) {
+   if (division >= 0x8000) {
+      int framespersecond = ((!(division >> 8))+1) & 0x00ff;
+      int resolution      = division & 0x00ff;
+      switch (framespersecond) {
+         case 232:  framespersecond = 24; break;
+         case 231:  framespersecond = 25; break;
+         case 227:  framespersecond = 29; break;
+         case 226:  framespersecond = 30; break;
+         default:
+               cerr << "Warning: unknown FPS: " << framespersecond << endl;
+               framespersecond = 255 - framespersecond + 1;
+               cerr << "Setting FPS to " << framespersecond << endl;
+      }
+      // actually ticks per second (except for frame=29 (drop frame)):
+      ticksPerQuarterNote = division;
+
+      cerr << "SMPTE ticks: " << ticksPerQuarterNote << " ticks/sec" << endl;
+      cerr << "SMPTE frames per second: " << framespersecond << endl;
+      cerr << "SMPTE frame resolution per frame: " << resolution << endl;
+   }  else {
+      ticksPerQuarterNote = division;
+   }
+}
+
+
 
 //////////////////////////////
 //
@@ -1837,7 +1988,6 @@ void MidiFile::clear(void) {
    events.resize(1);
    events[0] = new MidiEventList;
    timemapvalid=0;
-   timemap.clear();
    theTrackState = TRACK_STATE_SPLIT;
    theTimeState = TIME_STATE_ABSOLUTE;
 }
@@ -2058,24 +2208,10 @@ double MidiFile::getTimeInSeconds(int tickvalue) {
       }
    }
 
-   _TickTime key;
-   key.tick    = tickvalue;
-   key.seconds = -1;
-
-   void* ptr = bsearch(&key, timemap.data(), timemap.size(),
-         sizeof(_TickTime), ticksearch);
-
-   if (ptr == NULL) {
-      // The specific tick value was not found, so do a linear
-      // search for the two tick values which occur before and
-      // after the tick value, and do a linear interpolation of
-      // the time in seconds values to figure out the final
-      // time in seconds.
-      // Since the code is not yet written, kill the program at this point:
-      return linearSecondInterpolationAtTick(tickvalue);
-   } else {
-      return ((_TickTime*)ptr)->seconds;
+   if (tickvalue < 0) {
+      return -1.0;
    }
+   return tempomap.getSecondsAtTick(tickvalue);
 }
 
 
@@ -2083,37 +2219,37 @@ double MidiFile::getTimeInSeconds(int tickvalue) {
 //////////////////////////////
 //
 // MidiFile::getAbsoluteTickTime -- return the tick value represented
-//    by the input time in seconds.  If there is not tick entry at
-//    the given time in seconds, then interpolate between two values.
+//    by the input time in seconds.  The tempo segments are searched for
+//    the time, and the tick is interpolated within the segment.
 //
 
 int MidiFile::getAbsoluteTickTime(double starttime) {
    if (timemapvalid == 0) {
       buildTimeMap();
       if (timemapvalid == 0) {
-         if (timemapvalid == 0) {
-            return -1.0;    // something went wrong
-         }
+         return -1;    // something went wrong
       }
    }
 
-   _TickTime key;
-   key.tick    = -1;
-   key.seconds = starttime;
+   if (starttime < 0.0) {
+      return -1;
+   }
+   return (int)tempomap.getTickAtSeconds(starttime);
+}
+
 
-   void* ptr = bsearch(&key, timemap.data(), timemap.size(),
-         sizeof(_TickTime), secondsearch);
 
-   if (ptr == NULL) {
-      // The specific seconds value was not found, so do a linear
-      // search for the two time values which occur before and
-      // after the given time value, and do a linear interpolation of
-      // the time in tick values to figure out the final time in ticks.
-      return linearTickInterpolationAtSecond(starttime);
-   } else {
-      return ((_TickTime*)ptr)->tick;
-   }
+//////////////////////////////
+//
+// MidiFile::getTempoMap -- return the tempo segments of the file, building
+//    them first if necessary.
+//
 
+const MidiTempoMap& MidiFile::getTempoMap(void) {
+   if (timemapvalid == 0) {
+      buildTimeMap();
+   }
+   return tempomap;
 }
 
 
@@ -2248,219 +2384,39 @@ void MidiFile::clearLinks(void) {
 
 //////////////////////////////
 //
-// MidiFile::linearTickInterpolationAtSecond -- return the tick value at the
-//    given input time.
-//
-
-int MidiFile::linearTickInterpolationAtSecond(double seconds) {
-   if (timemapvalid == 0) {
-      buildTimeMap();
-      if (timemapvalid == 0) {
-         return -1.0;    // something went wrong
-      }
-   }
-
-   int i;
-   double lasttime = timemap[timemap.size()-1].seconds;
-   // give an error value of -1 if time is out of range of data.
-   if (seconds < 0.0) {
-      return -1;
-   }
-   if (seconds > timemap[timemap.size()-1].seconds) {
-      return -1;
-   }
-
-   // Guess which side of the list is closest to target:
-   // Could do a more efficient algorithm since time values are sorted,
-   // but good enough for now...
-   int startindex = -1;
-   if (seconds < lasttime / 2) {
-      for (i=0; i<(int)timemap.size(); i++) {
-         if (timemap[i].seconds > seconds) {
-            startindex = i-1;
-            break;
-         } else if (timemap[i].seconds == seconds) {
-            startindex = i;
-            break;
-         }
-      }
-   } else {
-      for (i=(int)timemap.size()-1; i>0; i--) {
-         if (timemap[i].seconds < seconds) {
-            startindex = i+1;
-            break;
-         } else if (timemap[i].seconds == seconds) {
-            startindex = i;
-            break;
-         }
-      }
-   }
-
-   if (startindex < 0) {
-      return -1;
-   }
-   if (startindex >= (int)timemap.size()-1) {
-      return -1;
-   }
-
-   double x1 = timemap[startindex].seconds;
-   double x2 = timemap[startindex+1].seconds;
-   double y1 = timemap[startindex].tick;
-   double y2 = timemap[startindex+1].tick;
-   double xi = seconds;
-
-   return (xi-x1) * ((y2-y1)/(x2-x1)) + y1;
-}
-
-
-
-//////////////////////////////
-//
-// MidiFile::linearSecondInterpolationAtTick -- return the time in seconds
-//    value at the given input tick time. (Ticks input could be made double).
-//
-
-double MidiFile::linearSecondInterpolationAtTick(int ticktime) {
-   if (timemapvalid == 0) {
-      buildTimeMap();
-      if (timemapvalid == 0) {
-         return -1.0;    // something went wrong
-      }
-   }
-
-   int i;
-   double lasttick = timemap[timemap.size()-1].tick;
-   // give an error value of -1 if time is out of range of data.
-   if (ticktime < 0.0) {
-      return -1;
-   }
-   if (ticktime > timemap.back().tick) {
-      return -1;  // don't try to extrapolate
-   }
-
-   // Guess which side of the list is closest to target:
-   // Could do a more efficient algorithm since time values are sorted,
-   // but good enough for now...
-   int startindex = -1;
-   if (ticktime < lasttick / 2) {
-      for (i=0; i<(int)timemap.size(); i++) {
-         if (timemap[i].tick > ticktime) {
-            startindex = i-1;
-            break;
-         } else if (timemap[i].tick == ticktime) {
-            startindex = i;
-            break;
-         }
-      }
-   } else {
-      for (i=(int)timemap.size()-1; i>0; i--) {
-         if (timemap[i].tick < ticktime) {
-            startindex = i;
-            break;
-         } else if (timemap[i].tick == ticktime) {
-            startindex = i;
-            break;
-         }
-      }
-   }
-
-   if (startindex < 0) {
-      return -1;
-   }
-   if (startindex >= (int)timemap.size()-1) {
-      return -1;
-   }
-
-   if (timemap[startindex].tick == ticktime) {
-      return timemap[startindex].seconds;
-   }
-
-   double x1 = timemap[startindex].tick;
-   double x2 = timemap[startindex+1].tick;
-   double y1 = timemap[startindex].seconds;
-   double y2 = timemap[startindex+1].seconds;
-   double xi = ticktime;
-
-   return (xi-x1) * ((y2-y1)/(x2-x1)) + y1;
-}
-
-
-
-//////////////////////////////
-//
-// MidiFile::buildTimeMap -- build an index of the absolute tick values
-//      found in a MIDI file, and their corresponding time values in
-//      seconds, taking into consideration tempo change messages.  If no
-//      tempo messages are given (or until they are given, then the
-//      tempo is set to 120 beats per minute).  If SMPTE time code is
-//      used, then ticks are actually time values.  So don't build
-//      a time map for SMPTE ticks, and just calculate the time in
-//      seconds from the tick value (1000 ticks per second SMPTE
-//      is the only mode tested (25 frames per second and 40 subframes
-//      per frame).
+// MidiFile::buildTimeMap -- build the tempo segments of the MIDI file
+//      and the time in seconds of every event, taking into consideration
+//      tempo change messages.  If no tempo messages are given (or until
+//      they are given, then the tempo is set to 120 beats per minute).
+//      SMPTE divisions are used as ticks per quarter note.  Each track
+//      is converted on its own by walking the tempo segments alongside
+//      its events, so the tracks do not need to be joined.
 //
 
 void MidiFile::buildTimeMap(void) {
 
-   // convert the MIDI file to absolute time representation
-   // in single track mode (and undo if the MIDI file was not
-   // in that state when this function was called.
+   // convert the MIDI file to absolute time representation (and undo
+   // if the MIDI file was not in that state when this function was
+   // called).
    //
-   int trackstate = getTrackState();
    int timestate  = getTickState();
 
    absoluteTicks();
-   joinTracks();
-
-   int allocsize = getNumEvents(0);
-   timemap.reserve(allocsize+10);
-   timemap.clear();
 
-   _TickTime value;
+   tempomap.build(*this);
 
-   int lasttick = 0;
-   int curtick;
-   int tickinit = 0;
-
-   int i;
-   int tpq = getTicksPerQuarterNote();
-   double defaultTempo = 120.0;
-   double secondsPerTick = 60.0 / (defaultTempo * tpq);
-
-   double lastsec = 0.0;
-   double cursec = 0.0;
-
-   for (i=0; i<getNumEvents(0); i++) {
-      curtick = getEvent(0, i).tick;
-      getEvent(0, i).seconds = cursec;
-      if ((curtick > lasttick) || !tickinit) {
-         tickinit = 1;
-
-         // calculate the current time in seconds:
-         cursec = lastsec + (curtick - lasttick) * secondsPerTick;
-         getEvent(0, i).seconds = cursec;
-
-         // store the new tick to second mapping
-         value.tick = curtick;
-         value.seconds = cursec;
-         timemap.push_back(value);
-         lasttick   = curtick;
-         lastsec    = cursec;
-      }
-
-      // update the tempo if needed:
-      if (getEvent(0,i).isTempo()) {
-         secondsPerTick = getEvent(0,i).getTempoSPT(getTicksPerQuarterNote());
+   for (int i=0; i<getTrackCount(); i++) {
+      int segment = 0;
+      for (int j=0; j<getNumEvents(i); j++) {
+         MidiEvent& event = getEvent(i, j);
+         event.seconds = tempomap.getSecondsAtTick(event.tick, segment);
       }
    }
 
-   // reset the states of the tracks or time values if necessary here:
+   // reset the time values if necessary here:
    if (timestate == TIME_STATE_DELTA) {
       deltaTicks();
    }
-   if (trackstate == TRACK_STATE_SPLIT) {
-      splitTracks();
-   }
 
    timemapvalid = 1;
 
@@ -2468,39 +2424,11 @@ void MidiFile::buildTimeMap(void) {
 
 double MidiFile::findSecondsPerTick(double time)
 {
-	int trackstate = getTrackState();
-	int timestate = getTickState();
-
-	absoluteTicks();
-	joinTracks();
-
-	int i;
-	int tpq = getTicksPerQuarterNote();
-	double defaultTempo = 120.0;
-	double secondsPerTick = 60.0 / (defaultTempo * tpq);
-
-	for (i = 0; i < getNumEvents(0); i++) 
+	if (timemapvalid == 0)
 	{
-		// update the tempo if needed:
-		if (getEvent(0, i).isTempo())
-		{
-			secondsPerTick = getEvent(0, i).getTempoSPT(getTicksPerQuarterNote());
-		}
-
-		if (time > getEvent(0, i).seconds)
-		{
-			break;
-		}
+		buildTimeMap();
 	}
-
-	// reset the states of the tracks or time values if necessary here:
-	if (timestate == TIME_STATE_DELTA) {
-		deltaTicks();
-	}
-	if (trackstate == TRACK_STATE_SPLIT) {
-		splitTracks();
-	}
-	return secondsPerTick;
+	return tempomap.getSecondsPerTickAtSeconds(time);
 }
 
 //////////////////////////////
@@ -2715,7 +2643,6 @@ void MidiFile::clear_no_deallocate(void) {
    events.resize(1);
    events[0] = new MidiEventList;
    timemapvalid=0;
-   timemap.clear();
    // events.resize(0);   // causes a memory leak [20150205 Jorden Thatcher]
 }
 
@@ -2805,43 +2732,6 @@ ostream& operator<<(ostream& out, MidiFile& aMidiFile) {
 
 
 
-//////////////////////////////
-//
-// MidiFile::ticksearch -- for finding a tick entry in the time map.
-//
-
-int MidiFile::ticksearch(const void* A, const void* B) {
-   _TickTime& a = *((_TickTime*)A);
-   _TickTime& b = *((_TickTime*)B);
-
-   if (a.tick < b.tick) {
-      return -1;
-   } else if (a.tick > b.tick) {
-      return 1;
-   }
-   return 0;
-}
-
-
-
-//////////////////////////////
-//
-// MidiFile::secondsearch -- for finding a second entry in the time map.
-//
-
-int MidiFile::secondsearch(const void* A, const void* B) {
-   _TickTime& a = *((_TickTime*)A);
-   _TickTime& b = *((_TickTime*)B);
-
-   if (a.seconds < b.seconds) {
-      return -1;
-   } else if (a.seconds > b.seconds) {
-      return 1;
-   }
-   return 0;
-}
-
-
 ///////////////////////////////////////////////////////////////////////////
 //
 // Static functions:
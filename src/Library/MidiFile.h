@@ -28,6 +28,7 @@
 #define _MIDIFILE_H_INCLUDED
 
 #include "MidiEventList.h"
+#include "MidiTempoMap.h"
 
 #include <vector>
 #include <istream>
@@ -41,13 +42,6 @@ using namespace std;
 #define TRACK_STATE_SPLIT      0
 #define TRACK_STATE_JOINED     1
 
-class _TickTime {
-   public:
-      int    tick;
-      double seconds;
-};
-
-
 class MidiFile {
    public:
                 MidiFile                  (void);
@@ -62,6 +56,7 @@ class MidiFile {
       int       read                      (const char* aFile);
       int       read                      (const string& aFile);
       int       read                      (istream& istream);
+      int       read                      (const uchar* data, size_t size);
       int       write                     (const char* aFile);
       int       write                     (const string& aFile);
       int       write                     (ostream& out);
@@ -130,6 +125,7 @@ class MidiFile {
       double    getTimeInSeconds          (int aTrack, int anIndex);
       double    getTimeInSeconds          (int tickvalue);
       int       getAbsoluteTickTime       (double starttime);
+      const MidiTempoMap& getTempoMap     (void);
 
       double    getTotalTimeInSeconds     (void);
       int       getTotalTimeInTicks       (void);
@@ -226,21 +222,19 @@ class MidiFile {
       vector<char>     readFileName;             // read file name
 
       int               timemapvalid;
-      vector<_TickTime> timemap;
+      MidiTempoMap      tempomap;                 // tempo segments
       int               rwstatus;                // read/write success flag
 
    private:
+      void       initializeTracks (int count);
+      void       setDivision      (int division);
       int        extractMidiData  (istream& inputfile, vector<uchar>& array,
                                        uchar& runningCommand);
       ulong      readVLValue      (istream& inputfile);
       ulong      unpackVLV        (uchar a, uchar b, uchar c, uchar d, uchar e);
       void       writeVLValue     (long aValue, vector<uchar>& data);
       int        makeVLV          (uchar *buffer, int number);
-      static int ticksearch       (const void* A, const void* B);
-      static int secondsearch     (const void* A, const void* B);
       void       buildTimeMap     (void);
-      int        linearTickInterpolationAtSecond  (double seconds);
-      double     linearSecondInterpolationAtTick  (int ticktime);
 };
 
 
@@ -0,0 +1,141 @@
+//
+// Filename:      midifile/include/MidiMergeIterator.h
+// Syntax:        C++11
+// vim:           ts=3 expandtab
+//
+// Description:   Walks the events of all tracks in global time order
+//                without joining the tracks.  Each track must already be
+//                sorted in absolute ticks (which is the case after reading
+//                a file).  Events are visited in (tick, track, index)
+//                order, the same order as joinTracks() produces after
+//                markSequence().  Works with MidiFile and MidiEventStore,
+//                or any class with getTrackCount(), getNumEvents(track)
+//                and getEvent(track, index).tick.
+//
+
+#ifndef _MIDIMERGEITERATOR_H_INCLUDED
+#define _MIDIMERGEITERATOR_H_INCLUDED
+
+#include <vector>
+#include <utility>
+
+using namespace std;
+
+
+template <class T>
+class MidiMergeIterator {
+   public:
+      MidiMergeIterator(T& source);
+
+      int  isValid     (void) const { return !heap.empty(); }
+      void next        (void);
+
+      int  getTrack    (void) const { return heap[0].track; }
+      int  getIndex    (void) const { return heap[0].index; }
+      int  getTick     (void) const { return heap[0].tick; }
+      auto getEvent    (void) const
+            -> decltype(declval<T&>().getEvent(0, 0)) {
+         return source.getEvent(heap[0].track, heap[0].index);
+      }
+
+   private:
+      struct Cursor {
+         int tick;
+         int track;
+         int index;
+      };
+
+      static int before(const Cursor& a, const Cursor& b) {
+         return (a.tick < b.tick) || ((a.tick == b.tick) && (a.track < b.track));
+      }
+
+      void siftDown    (int position);
+
+      T&             source;
+      vector<Cursor> heap;        // one cursor per non-empty track
+};
+
+
+
+//////////////////////////////
+//
+// MidiMergeIterator::MidiMergeIterator -- Position on the earliest event.
+//    The only allocation is the heap of track cursors.
+//
+
+template <class T>
+MidiMergeIterator<T>::MidiMergeIterator(T& asource) : source(asource) {
+   int tracks = source.getTrackCount();
+   heap.reserve(tracks);
+   Cursor cursor;
+   for (int i=0; i<tracks; i++) {
+      if (source.getNumEvents(i) > 0) {
+         cursor.tick  = source.getEvent(i, 0).tick;
+         cursor.track = i;
+         cursor.index = 0;
+         heap.push_back(cursor);
+      }
+   }
+   for (int i=(int)heap.size()/2 - 1; i>=0; i--) {
+      siftDown(i);
+   }
+}
+
+
+
+//////////////////////////////
+//
+// MidiMergeIterator::next -- Advance to the following event.  The current
+//    track's cursor moves forward in place, so events that stay on the
+//    same track only cost a couple of comparisons.
+//
+
+template <class T>
+void MidiMergeIterator<T>::next(void) {
+   Cursor& top = heap[0];
+   top.index++;
+   if (top.index < source.getNumEvents(top.track)) {
+      top.tick = source.getEvent(top.track, top.index).tick;
+   } else {
+      top = heap.back();
+      heap.pop_back();
+      if (heap.empty()) {
+         return;
+      }
+   }
+   siftDown(0);
+}
+
+
+
+//////////////////////////////
+//
+// MidiMergeIterator::siftDown --
+//
+
+template <class T>
+void MidiMergeIterator<T>::siftDown(int position) {
+   int count = (int)heap.size();
+   Cursor item = heap[position];
+   while (1) {
+      int child = 2 * position + 1;
+      if (child >= count) {
+         break;
+      }
+      if ((child + 1 < count) && before(heap[child+1], heap[child])) {
+         child++;
+      }
+      if (!before(heap[child], item)) {
+         break;
+      }
+      heap[position] = heap[child];
+      position = child;
+   }
+   heap[position] = item;
+}
+
+
+#endif /* _MIDIMERGEITERATOR_H_INCLUDED */
+
+
+
@@ -0,0 +1,161 @@
+//
+// Filename:      midifile/src/MidiProbe.cpp
+// Syntax:        C++11
+// vim:           ts=3 expandtab
+//
+// Description:   Summary of a Standard MIDI File in memory.
+//
+
+#include "MidiProbe.h"
+#include "MidiByteReader.h"
+#include "MidiTempoMap.h"
+
+#include <algorithm>
+
+using namespace std;
+
+
+//////////////////////////////
+//
+// probeMidi -- Walk the events of every track once, the way
+//    MidiEventStore::read() does, counting instead of storing them.  The
+//    tempo changes are only put in order at the end, to convert their
+//    ticks and the length of the song to seconds.  Nothing is printed
+//    on failure, since a scan of a collection expects some bad files.
+//
+
+int probeMidi(const uchar* data, size_t size, MidiProbeInfo& info) {
+   info.type = 0;
+   info.trackCount = 0;
+   info.ticksPerQuarterNote = 0;
+   info.totalTicks = 0;
+   info.totalSeconds = 0.0;
+   info.eventCount = 0;
+   info.noteCount = 0;
+   info.minKey = -1;
+   info.maxKey = -1;
+   info.tempos.clear();
+   info.timeSignatures.clear();
+
+   MidiByteReader reader(data, size);
+   unsigned int   longdata;
+   unsigned short shortdata;
+   unsigned short type;
+   unsigned short tracks;
+
+   if (!reader.matchTag("MThd") || !reader.read4Bytes(longdata) ||
+         longdata != 6) {
+      return 0;
+   }
+   if (!reader.read2Bytes(type) || !reader.read2Bytes(tracks) ||
+         !reader.read2Bytes(shortdata)) {
+      return 0;
+   }
+   if ((type != 0 && type != 1) || (type == 0 && tracks != 1)) {
+      return 0;
+   }
+   info.type = type;
+   info.trackCount = tracks;
+   info.ticksPerQuarterNote = shortdata;
+
+   uchar runningCommand;
+   MidiRawEvent raw;
+   int absticks;
+   int events = 0;
+   int notes = 0;
+   int minkey = 128;
+   int maxkey = -1;
+
+   for (int i=0; i<tracks; i++) {
+      if (!reader.matchTag("MTrk") || !reader.read4Bytes(longdata)) {
+         return 0;
+      }
+
+      runningCommand = 0;
+      absticks = 0;
+      while (1) {
+         if (!reader.readVLValue(longdata) ||
+               !reader.readEvent(runningCommand, raw)) {
+            return 0;
+         }
+         absticks += (int)longdata;
+         events++;
+
+         if ((raw.command & 0xf0) == 0x90) {
+            if (raw.data[1] != 0) {
+               int key = raw.data[0];
+               notes++;
+               if (key < minkey) {
+                  minkey = key;
+               }
+               if (key > maxkey) {
+                  maxkey = key;
+               }
+            }
+         } else if (raw.command == 0xff && raw.size > 0) {
+            if (raw.data[0] == 0x2f) {
+               // end of track message
+               break;
+            } else if (raw.data[0] == 0x51 && raw.size == 5) {
+               MidiProbeTempo tempo;
+               tempo.tick = absticks;
+               tempo.microseconds = (raw.data[2] << 16) |
+                     (raw.data[3] << 8) | raw.data[4];
+               tempo.seconds = 0.0;
+               info.tempos.push_back(tempo);
+            } else if (raw.data[0] == 0x58 && raw.size == 6) {
+               MidiProbeTimeSignature signature;
+               signature.tick = absticks;
+               signature.numerator = raw.data[2];
+               signature.denominator = 1 << (raw.data[3] & 0x1f);
+               signature.seconds = 0.0;
+               info.timeSignatures.push_back(signature);
+            }
+         }
+      }
+
+      if (absticks > info.totalTicks) {
+         info.totalTicks = absticks;
+      }
+   }
+
+   info.eventCount = events;
+   info.noteCount = notes;
+   if (notes > 0) {
+      info.minKey = minkey;
+      info.maxKey = maxkey;
+   }
+
+   stable_sort(info.tempos.begin(), info.tempos.end(),
+         [](const MidiProbeTempo& a, const MidiProbeTempo& b) {
+            return a.tick < b.tick;
+         });
+   stable_sort(info.timeSignatures.begin(), info.timeSignatures.end(),
+         [](const MidiProbeTimeSignature& a, const MidiProbeTimeSignature& b) {
+            return a.tick < b.tick;
+         });
+
+   MidiTempoMap tempomap;
+   tempomap.reset(info.ticksPerQuarterNote);
+   for (int i=0; i<(int)info.tempos.size(); i++) {
+      tempomap.addTempo(info.tempos[i].tick, info.tempos[i].microseconds /
+            1000000.0 / info.ticksPerQuarterNote);
+   }
+
+   int segment = 0;
+   for (int i=0; i<(int)info.tempos.size(); i++) {
+      info.tempos[i].seconds = tempomap.getSecondsAtTick(info.tempos[i].tick,
+            segment);
+   }
+   segment = 0;
+   for (int i=0; i<(int)info.timeSignatures.size(); i++) {
+      info.timeSignatures[i].seconds = tempomap.getSecondsAtTick(
+            info.timeSignatures[i].tick, segment);
+   }
+   info.totalSeconds = tempomap.getSecondsAtTick(info.totalTicks);
+
+   return 1;
+}
+
+
+
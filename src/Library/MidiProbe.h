@@ -0,0 +1,72 @@
+//
+// Filename:      midifile/include/MidiProbe.h
+// Syntax:        C++11
+// vim:           ts=3 expandtab
+//
+// Description:   Summary of a Standard MIDI File in memory, gathered in a
+//                single pass over its bytes.  No events are stored: only
+//                counters are kept, plus the tempo and time signature
+//                changes, so scanning a large collection of files costs
+//                little more than reading them.
+//
+
+#ifndef _MIDIPROBE_H_INCLUDED
+#define _MIDIPROBE_H_INCLUDED
+
+#include <stddef.h>
+#include <vector>
+
+using namespace std;
+
+typedef unsigned char  uchar;
+
+
+struct MidiProbeTempo {
+   int    tick;
+   int    microseconds;        // per quarter note
+   double seconds;             // time of the change in the song
+};
+
+
+struct MidiProbeTimeSignature {
+   int    tick;
+   int    numerator;
+   int    denominator;         // 4 for quarter notes, 8 for eighths...
+   double seconds;
+};
+
+
+//////////////////////////////
+//
+// MidiProbeInfo -- Results of probeMidi().  Notes are note-ons with a
+//    non-zero velocity; minKey and maxKey are -1 when there are none.
+//    Tempo and time signature changes are listed in time order, earlier
+//    tracks first for changes at the same tick.  Without tempo changes
+//    the duration is computed at 120 beats per minute.
+//
+
+struct MidiProbeInfo {
+   int    type;
+   int    trackCount;
+   int    ticksPerQuarterNote;
+   int    totalTicks;           // tick of the latest event in any track
+   double totalSeconds;
+   int    eventCount;
+   int    noteCount;
+   int    minKey;
+   int    maxKey;
+
+   vector<MidiProbeTempo>         tempos;
+   vector<MidiProbeTimeSignature> timeSignatures;
+};
+
+
+// Returns 1 on success and 0 if the file could not be parsed.  Accepts
+// the same files as MidiEventStore::read().
+int probeMidi(const uchar* data, size_t size, MidiProbeInfo& info);
+
+
+#endif /* _MIDIPROBE_H_INCLUDED */
+
+
+
@@ -0,0 +1,232 @@
+//
+// Filename:      midifile/src/MidiTempoMap.cpp
+// Syntax:        C++11
+// vim:           ts=3 expandtab
+//
+// Description:   Conversion between absolute ticks and seconds.
+//
+
+#include "MidiTempoMap.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+      (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+   #define MIDITEMPOMAP_SSE2
+   #include <emmintrin.h>
+#endif
+
+using namespace std;
+
+
+//////////////////////////////
+//
+// MidiTempoMap::MidiTempoMap -- Constructor.
+//
+
+MidiTempoMap::MidiTempoMap(void) {
+   reset(120);
+}
+
+
+
+//////////////////////////////
+//
+// MidiTempoMap::reset -- Remove all tempo changes.  Until the first one
+//    the tempo is 120 beats per minute.
+//
+
+void MidiTempoMap::reset(int tpq) {
+   double defaultTempo = 120.0;
+   MidiTempoSegment segment;
+   segment.tick = 0;
+   segment.seconds = 0.0;
+   segment.secondsPerTick = 60.0 / (defaultTempo * tpq);
+
+   segments.clear();
+   segments.push_back(segment);
+}
+
+
+
+//////////////////////////////
+//
+// MidiTempoMap::addTempo -- Append a tempo change.  Changes must be added
+//    in time order.  A tempo change affects the time after its tick, and
+//    when several changes share a tick the last one wins.
+//
+
+void MidiTempoMap::addTempo(int tick, double secondsPerTick) {
+   MidiTempoSegment& last = segments.back();
+   if (tick <= last.tick) {
+      last.secondsPerTick = secondsPerTick;
+      return;
+   }
+
+   MidiTempoSegment segment;
+   segment.tick = tick;
+   segment.seconds = last.seconds + (tick - last.tick) * last.secondsPerTick;
+   segment.secondsPerTick = secondsPerTick;
+   segments.push_back(segment);
+}
+
+
+
+//////////////////////////////
+//
+// MidiTempoMap::getSegmentCount -- Returns the number of tempo segments.
+//    There is always at least one.
+//
+
+int MidiTempoMap::getSegmentCount(void) const {
+   return (int)segments.size();
+}
+
+
+
+//////////////////////////////
+//
+// MidiTempoMap::getSegment --
+//
+
+const MidiTempoSegment& MidiTempoMap::getSegment(int index) const {
+   return segments[index];
+}
+
+
+
+//////////////////////////////
+//
+// MidiTempoMap::findSegmentAtTick -- Returns the index of the segment
+//    containing the given tick.  Ticks before zero belong to the first
+//    segment.
+//
+
+int MidiTempoMap::findSegmentAtTick(int tick) const {
+   int low  = 0;
+   int high = (int)segments.size() - 1;
+   while (low < high) {
+      int mid = (low + high + 1) / 2;
+      if (segments[mid].tick <= tick) {
+         low = mid;
+      } else {
+         high = mid - 1;
+      }
+   }
+   return low;
+}
+
+
+
+//////////////////////////////
+//
+// MidiTempoMap::findSegmentAtSeconds -- Returns the index of the segment
+//    containing the given time.
+//
+
+int MidiTempoMap::findSegmentAtSeconds(double seconds) const {
+   int low  = 0;
+   int high = (int)segments.size() - 1;
+   while (low < high) {
+      int mid = (low + high + 1) / 2;
+      if (segments[mid].seconds <= seconds) {
+         low = mid;
+      } else {
+         high = mid - 1;
+      }
+   }
+   return low;
+}
+
+
+
+//////////////////////////////
+//
+// MidiTempoMap::getSecondsAtTick -- Returns the time of a tick.
+//
+
+double MidiTempoMap::getSecondsAtTick(int tick) const {
+   const MidiTempoSegment& s = segments[findSegmentAtTick(tick)];
+   return s.seconds + (tick - s.tick) * s.secondsPerTick;
+}
+
+
+
+//////////////////////////////
+//
+// MidiTempoMap::getTickAtSeconds -- Returns the (fractional) tick at
+//    the given time.
+//
+
+double MidiTempoMap::getTickAtSeconds(double seconds) const {
+   const MidiTempoSegment& s = segments[findSegmentAtSeconds(seconds)];
+   return s.tick + (seconds - s.seconds) / s.secondsPerTick;
+}
+
+
+
+//////////////////////////////
+//
+// MidiTempoMap::getSecondsPerTickAtTick -- Returns the tempo in effect
+//    at a tick, in seconds per tick.
+//
+
+double MidiTempoMap::getSecondsPerTickAtTick(int tick) const {
+   return segments[findSegmentAtTick(tick)].secondsPerTick;
+}
+
+
+double MidiTempoMap::getSecondsPerTickAtSeconds(double seconds) const {
+   return segments[findSegmentAtSeconds(seconds)].secondsPerTick;
+}
+
+
+
+//////////////////////////////
+//
+// MidiTempoMap::getSecondsAtTicks -- Convert an array of ticks to seconds.
+//    The input is split into runs of ticks which fall in the same segment,
+//    and each run is converted two at a time with SSE2.  Ascending input
+//    finds every run with the sequential lookup, but any order works.
+//
+
+void MidiTempoMap::getSecondsAtTicks(const int* ticks, double* seconds,
+      int count) const {
+   int segcount = (int)segments.size();
+   int segment = 0;
+   int i = 0;
+   while (i < count) {
+      getSecondsAtTick(ticks[i], segment);
+      const MidiTempoSegment& s = segments[segment];
+      int endtick = (segment + 1 < segcount) ? segments[segment+1].tick : 0;
+
+      // find the end of the run of ticks inside this segment
+      int j = i + 1;
+      if (segment + 1 < segcount) {
+         while ((j < count) && (ticks[j] >= s.tick) && (ticks[j] < endtick)) {
+            j++;
+         }
+      } else {
+         while ((j < count) && (ticks[j] >= s.tick)) {
+            j++;
+         }
+      }
+
+      int k = i;
+#ifdef MIDITEMPOMAP_SSE2
+      __m128i starttick = _mm_set1_epi32(s.tick);
+      __m128d spt       = _mm_set1_pd(s.secondsPerTick);
+      __m128d start     = _mm_set1_pd(s.seconds);
+      for (; k + 2 <= j; k += 2) {
+         __m128i t = _mm_loadl_epi64((const __m128i*)(ticks + k));
+         __m128d d = _mm_cvtepi32_pd(_mm_sub_epi32(t, starttick));
+         _mm_storeu_pd(seconds + k, _mm_add_pd(start, _mm_mul_pd(d, spt)));
+      }
+#endif
+      for (; k < j; k++) {
+         seconds[k] = s.seconds + (ticks[k] - s.tick) * s.secondsPerTick;
+      }
+      i = j;
+   }
+}
+
+
+
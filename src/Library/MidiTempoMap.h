@@ -0,0 +1,109 @@
+//
+// Filename:      midifile/include/MidiTempoMap.h
+// Syntax:        C++11
+// vim:           ts=3 expandtab
+//
+// Description:   Conversion between absolute ticks and seconds.  The map
+//                holds one segment per tempo change (start tick, start
+//                time and seconds per tick), so lookups are a binary
+//                search in either direction instead of a scan over every
+//                event tick.
+//
+
+#ifndef _MIDITEMPOMAP_H_INCLUDED
+#define _MIDITEMPOMAP_H_INCLUDED
+
+#include "MidiMergeIterator.h"
+
+#include <vector>
+
+using namespace std;
+
+
+struct MidiTempoSegment {
+   int    tick;
+   double seconds;
+   double secondsPerTick;
+};
+
+
+class MidiTempoMap {
+   public:
+                     MidiTempoMap            (void);
+
+      // building the map:
+      void           reset                   (int tpq);
+      void           addTempo                (int tick, double secondsPerTick);
+      template <class T>
+      void           build                   (T& source);
+
+      int            getSegmentCount         (void) const;
+      const MidiTempoSegment& getSegment     (int index) const;
+      int            findSegmentAtTick       (int tick) const;
+      int            findSegmentAtSeconds    (double seconds) const;
+
+      // conversions:
+      double         getSecondsAtTick        (int tick) const;
+      double         getSecondsAtTick        (int tick, int& segment) const;
+      double         getTickAtSeconds        (double seconds) const;
+      double         getSecondsPerTickAtTick (int tick) const;
+      double         getSecondsPerTickAtSeconds (double seconds) const;
+      void           getSecondsAtTicks       (const int* ticks, double* seconds,
+                                              int count) const;
+
+   private:
+      vector<MidiTempoSegment> segments;
+};
+
+
+
+//////////////////////////////
+//
+// MidiTempoMap::build -- Collect the tempo messages of all tracks of a
+//    MidiFile or MidiEventStore (in absolute ticks).  The tracks are
+//    walked with a MidiMergeIterator, so the changes arrive in (tick,
+//    track) order, which is the order joinTracks() would give them,
+//    without joining or sorting anything.
+//
+
+template <class T>
+void MidiTempoMap::build(T& source) {
+   int tpq = source.getTicksPerQuarterNote();
+   reset(tpq);
+
+   for (MidiMergeIterator<T> it(source); it.isValid(); it.next()) {
+      const auto& event = it.getEvent();
+      if (event.isTempo()) {
+         addTempo(event.tick, event.getTempoSPT(tpq));
+      }
+   }
+}
+
+
+
+//////////////////////////////
+//
+// MidiTempoMap::getSecondsAtTick -- Sequential version of the lookup: the
+//    segment found last time is passed back in, so walking ascending ticks
+//    (such as the events of one track) costs O(1) per call.
+//
+
+inline double MidiTempoMap::getSecondsAtTick(int tick, int& segment) const {
+   int count = (int)segments.size();
+   if ((segment < 0) || (segment >= count) ||
+         (tick < segments[segment].tick)) {
+      segment = findSegmentAtTick(tick);
+   } else {
+      while ((segment + 1 < count) && (segments[segment+1].tick <= tick)) {
+         segment++;
+      }
+   }
+   const MidiTempoSegment& s = segments[segment];
+   return s.seconds + (tick - s.tick) * s.secondsPerTick;
+}
+
+
+#endif /* _MIDITEMPOMAP_H_INCLUDED */
+
+
+
@@ -0,0 +1,104 @@
+#include "Song.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define NOTELAYOUT_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace SR
+{
+	static_assert(sizeof(Rectangle) == sizeof(int32) * 4, "Rectangle is expected to be 4 packed int32s");
+
+	void NoteLayout::Build(const List<Note>& notes)
+	{
+		int32 count = notes.getCount();
+
+		m_time.ReserveDiscard(count);
+		m_duration.ReserveDiscard(count);
+		m_pitch.ReserveDiscard(count);
+		m_track.ReserveDiscard(count);
+		m_index.Clear();
+
+		int32 runStart = 0;
+		double runMaxDuration = 0;
+
+		for (int32 i = 0; i < count; i++)
+		{
+			const Note& n = notes[i];
+
+			m_time[i] = (float)n.Time;
+			m_duration[i] = (float)n.Duration;
+			m_pitch[i] = (byte)n.Base12;
+			m_track[i] = (byte)n.Track;
+
+			if (i > runStart && n.Track != notes[i - 1].Track)
+			{
+				m_index.AddRun(runStart, i - runStart, runMaxDuration);
+				runStart = i;
+				runMaxDuration = 0;
+			}
+			runMaxDuration = Math::Max(runMaxDuration, (double)m_duration[i]);
+		}
+		m_index.AddRun(runStart, count - runStart, runMaxDuration);
+	}
+
+	void NoteLayout::Clear()
+	{
+		m_time.Clear();
+		m_duration.Clear();
+		m_pitch.Clear();
+		m_track.Clear();
+		m_index.Clear();
+	}
+
+	void NoteLayout::ComputeRects(int32 first, int32 count, const NoteLayoutParams& params, Rectangle* result) const
+	{
+		const float* time = m_time.getElements() + first;
+		const float* duration = m_duration.getElements() + first;
+		const byte* pitch = m_pitch.getElements() + first;
+		const int32* columnX = params.columns->m_x;
+		const int32* columnWidth = params.columns->m_width;
+
+		int32 i = 0;
+
+#ifdef NOTELAYOUT_SSE2
+		const __m128 yScroll = _mm_set1_ps(params.yScroll);
+		const __m128 timeRes = _mm_set1_ps(params.timeResolution);
+		const __m128i height = _mm_set1_epi32(params.viewportHeight);
+
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128i x = _mm_setr_epi32(columnX[pitch[i]], columnX[pitch[i + 1]], columnX[pitch[i + 2]], columnX[pitch[i + 3]]);
+			__m128i w = _mm_setr_epi32(columnWidth[pitch[i]], columnWidth[pitch[i + 1]], columnWidth[pitch[i + 2]], columnWidth[pitch[i + 3]]);
+
+			__m128 t = _mm_loadu_ps(time + i);
+			__m128 d = _mm_loadu_ps(duration + i);
+
+			__m128i h = _mm_cvttps_epi32(_mm_mul_ps(d, timeRes));
+			__m128i y = _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(t, yScroll), timeRes));
+			y = _mm_sub_epi32(_mm_sub_epi32(height, y), h);
+
+			// transpose the four coordinate vectors into four rectangles
+			__m128i xy0 = _mm_unpacklo_epi32(x, y);
+			__m128i wh0 = _mm_unpacklo_epi32(w, h);
+			__m128i xy1 = _mm_unpackhi_epi32(x, y);
+			__m128i wh1 = _mm_unpackhi_epi32(w, h);
+
+			__m128i* dst = (__m128i*)(result + i);
+			_mm_storeu_si128(dst + 0, _mm_unpacklo_epi64(xy0, wh0));
+			_mm_storeu_si128(dst + 1, _mm_unpackhi_epi64(xy0, wh0));
+			_mm_storeu_si128(dst + 2, _mm_unpacklo_epi64(xy1, wh1));
+			_mm_storeu_si128(dst + 3, _mm_unpackhi_epi64(xy1, wh1));
+		}
+#endif
+
+		for (; i < count; i++)
+		{
+			Rectangle& area = result[i];
+			area.X = columnX[pitch[i]];
+			area.Width = columnWidth[pitch[i]];
+			area.Height = (int32)(duration[i] * params.timeResolution);
+			area.Y = params.viewportHeight - (int32)((time[i] - params.yScroll) * params.timeResolution) - area.Height;
+		}
+	}
+}
@@ -0,0 +1,116 @@
+#include "PixelRows.h"
+
+#if defined(PIXELROWS_SSE2)
+#include <emmintrin.h>
+#endif
+#if defined(PIXELROWS_SSSE3)
+#include <tmmintrin.h>
+#endif
+#if defined(PIXELROWS_AVX2)
+#include <immintrin.h>
+#endif
+
+namespace SR
+{
+	void PackRowRGB(const byte* src, byte* dst, int32 count)
+	{
+#if defined(PIXELROWS_AVX2)
+		PackRowRGBAVX2(src, dst, count);
+#elif defined(PIXELROWS_SSSE3)
+		PackRowRGBSSSE3(src, dst, count);
+#elif defined(PIXELROWS_SSE2)
+		PackRowRGBSSE2(src, dst, count);
+#else
+		PackRowRGBScalar(src, dst, count);
+#endif
+	}
+
+	void PackRowRGBScalar(const byte* src, byte* dst, int32 count)
+	{
+		for (int32 i = 0; i < count; i++)
+		{
+			dst[i * 3] = src[i * 4];
+			dst[i * 3 + 1] = src[i * 4 + 1];
+			dst[i * 3 + 2] = src[i * 4 + 2];
+		}
+	}
+
+#if defined(PIXELROWS_SSE2)
+	namespace
+	{
+		/** Writes 16 pixels from 4 registers holding 4 packed pixels each in their low 12 bytes, the rest 0 */
+		inline void Store48(byte* dst, __m128i a, __m128i b, __m128i c, __m128i d)
+		{
+			_mm_storeu_si128((__m128i*)dst, _mm_or_si128(a, _mm_slli_si128(b, 12)));
+			_mm_storeu_si128((__m128i*)(dst + 16), _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8)));
+			_mm_storeu_si128((__m128i*)(dst + 32), _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(d, 4)));
+		}
+
+		inline __m128i Pack4SSE2(const byte* src)
+		{
+			const __m128i rgb = _mm_set1_epi32(0x00ffffff);
+			const __m128i first = _mm_set_epi32(0, 0x00ffffff, 0, 0x00ffffff);
+			const __m128i second = _mm_set_epi32(0x0000ffff, (int)0xff000000, 0x0000ffff, (int)0xff000000);
+
+			__m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i*)src), rgb);
+
+			// the 2 pixels of each 64-bit half are closed up to 6 bytes, then the halves
+			v = _mm_or_si128(_mm_and_si128(v, first), _mm_and_si128(_mm_srli_epi64(v, 8), second));
+			return _mm_or_si128(_mm_move_epi64(v), _mm_slli_si128(_mm_srli_si128(v, 8), 6));
+		}
+	}
+
+	void PackRowRGBSSE2(const byte* src, byte* dst, int32 count)
+	{
+		int32 i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			const byte* s = src + i * 4;
+			Store48(dst + i * 3, Pack4SSE2(s), Pack4SSE2(s + 16), Pack4SSE2(s + 32), Pack4SSE2(s + 48));
+		}
+
+		PackRowRGBScalar(src + i * 4, dst + i * 3, count - i);
+	}
+#endif
+
+#if defined(PIXELROWS_SSSE3)
+	void PackRowRGBSSSE3(const byte* src, byte* dst, int32 count)
+	{
+		const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+		int32 i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			const __m128i* s = (const __m128i*)(src + i * 4);
+			Store48(dst + i * 3,
+				_mm_shuffle_epi8(_mm_loadu_si128(s), shuffle), _mm_shuffle_epi8(_mm_loadu_si128(s + 1), shuffle),
+				_mm_shuffle_epi8(_mm_loadu_si128(s + 2), shuffle), _mm_shuffle_epi8(_mm_loadu_si128(s + 3), shuffle));
+		}
+
+		PackRowRGBScalar(src + i * 4, dst + i * 3, count - i);
+	}
+#endif
+
+#if defined(PIXELROWS_AVX2)
+	void PackRowRGBAVX2(const byte* src, byte* dst, int32 count)
+	{
+		const __m256i shuffle = _mm256_setr_epi8(
+			0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+			0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+		// pshufb stays within 128-bit lanes, so the 12 bytes of each lane are joined by a dword permute
+		const __m256i join = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+
+		int32 i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256i v = _mm256_loadu_si256((const __m256i*)(src + i * 4));
+			v = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(v, shuffle), join);
+
+			_mm_storeu_si128((__m128i*)(dst + i * 3), _mm256_castsi256_si128(v));
+			_mm_storel_epi64((__m128i*)(dst + i * 3 + 16), _mm256_extracti128_si256(v, 1));
+		}
+
+		PackRowRGBScalar(src + i * 4, dst + i * 3, count - i);
+	}
+#endif
+}
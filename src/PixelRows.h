@@ -0,0 +1,41 @@
+#pragma once
+
+#include "SRCommon.h"
+
+// The kernels compiled in follow the instruction set the build allows. The
+// Win32 projects build with /arch:SSE2 by default, where _M_IX86_FP is 2.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define PIXELROWS_SSE2
+#endif
+
+// MSVC has no SSSE3 switch, /arch:AVX is the first that allows pshufb
+#if defined(__SSSE3__) || defined(__AVX__)
+#define PIXELROWS_SSSE3
+#endif
+
+#if defined(__AVX2__)
+#define PIXELROWS_AVX2
+#endif
+
+namespace SR
+{
+	/**
+	 *  Packs R, G, B, A pixels, such as a SoftwareCanvas' rows, into the
+	 *  3 bytes per pixel of a PNG RGB row, dropping alpha. Writes exactly
+	 *  count * 3 bytes. Uses the widest of the kernels below that the build has.
+	 */
+	void PackRowRGB(const byte* src, byte* dst, int32 count);
+
+	/** The kernels PackRowRGB picks from, each giving the same bytes. The SIMD ones finish odd counts with the scalar one. */
+	void PackRowRGBScalar(const byte* src, byte* dst, int32 count);
+#if defined(PIXELROWS_SSE2)
+	/** without a byte shuffle the pixels are closed up by 64-bit shifts */
+	void PackRowRGBSSE2(const byte* src, byte* dst, int32 count);
+#endif
+#if defined(PIXELROWS_SSSE3)
+	void PackRowRGBSSSE3(const byte* src, byte* dst, int32 count);
+#endif
+#if defined(PIXELROWS_AVX2)
+	void PackRowRGBAVX2(const byte* src, byte* dst, int32 count);
+#endif
+}
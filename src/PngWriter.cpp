@@ -0,0 +1,701 @@
+#include "PngWriter.h"
+#include "PixelRows.h"
+#include "WorkerPool.h"
+
+#include <zlib/zlib.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define PNGWRITER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace SR
+{
+	namespace
+	{
+		const int32 WindowSize = 32768;
+
+		// around the block size pigz uses, big enough that a band compresses
+		// nearly as well as it would in one stream
+		const int32 BandTargetBytes = 128 * 1024;
+
+		const byte PngSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+		/** IHDR color type of each PngColorMode */
+		const byte ColorTypes[] = { 6, 2, 3 };
+
+		enum FilterType
+		{
+			FILTER_None = 0,
+			FILTER_Sub = 1,
+			FILTER_Up = 2,
+			FILTER_Average = 3,
+			FILTER_Paeth = 4
+		};
+
+		/** How each PngProfile filters and deflates */
+		struct ProfileSettings
+		{
+			int32 level;
+			int32 strategy;
+
+			/** tried after no filter, in order, until one costs nothing */
+			FilterType filters[4];
+			int32 filterCount;
+
+			/** a row equal to the one above is Up filtered without trying anything */
+			bool repeatedRowFastPath;
+		};
+
+		const ProfileSettings Profiles[] =
+		{
+			// PNGPROF_General, what libpng does by default
+			{ Z_DEFAULT_COMPRESSION, Z_DEFAULT_STRATEGY, { FILTER_Sub, FILTER_Up, FILTER_Average, FILTER_Paeth }, 4, false },
+
+			// PNGPROF_FlatColor. Filtered flat areas are runs of zeros and a few
+			// repeating values, which run length matches catch at a fraction of
+			// the cost of searching for matches. Average rarely wins on them.
+			{ Z_BEST_SPEED, Z_RLE, { FILTER_Up, FILTER_Sub, FILTER_Paeth }, 3, true },
+		};
+
+		void WriteUInt32BE(byte* dst, uint32 v)
+		{
+			dst[0] = (byte)(v >> 24);
+			dst[1] = (byte)(v >> 16);
+			dst[2] = (byte)(v >> 8);
+			dst[3] = (byte)v;
+		}
+
+		/** The 2 byte zlib header deflateInit would write for these settings */
+		void MakeZlibHeader(int32 level, int32 strategy, byte* dst)
+		{
+			if (level == Z_DEFAULT_COMPRESSION)
+				level = 6;
+
+			int32 levelFlags;
+			if (strategy >= Z_HUFFMAN_ONLY || level < 2)
+				levelFlags = 0;
+			else if (level < 6)
+				levelFlags = 1;
+			else if (level == 6)
+				levelFlags = 2;
+			else
+				levelFlags = 3;
+
+			// deflate with a 32KB window, and a check value making it a multiple of 31
+			int32 header = (0x78 << 8) | (levelFlags << 6);
+			header += 31 - header % 31;
+
+			dst[0] = (byte)(header >> 8);
+			dst[1] = (byte)header;
+		}
+
+		byte PaethPredictor(int32 a, int32 b, int32 c)
+		{
+			int32 p = a + b - c;
+			int32 pa = abs(p - a);
+			int32 pb = abs(p - b);
+			int32 pc = abs(p - c);
+
+			if (pa <= pb && pa <= pc)
+				return (byte)a;
+			return (byte)(pb <= pc ? b : c);
+		}
+
+		// The filters below take the first pixel on its own, as it has no left
+		// neighbour, and the rest 16 bytes at a time where SSE2 is available.
+
+		void FilterSub(const byte* row, int32 rowBytes, int32 bpp, byte* dst)
+		{
+			int32 i = 0;
+			for (; i < bpp; i++)
+				dst[i] = row[i];
+
+#ifdef PNGWRITER_SSE2
+			for (; i + 16 <= rowBytes; i += 16)
+			{
+				__m128i x = _mm_loadu_si128((const __m128i*)(row + i));
+				__m128i a = _mm_loadu_si128((const __m128i*)(row + i - bpp));
+				_mm_storeu_si128((__m128i*)(dst + i), _mm_sub_epi8(x, a));
+			}
+#endif
+
+			for (; i < rowBytes; i++)
+				dst[i] = (byte)(row[i] - row[i - bpp]);
+		}
+
+		void FilterUp(const byte* row, const byte* prev, int32 rowBytes, byte* dst)
+		{
+			int32 i = 0;
+
+#ifdef PNGWRITER_SSE2
+			for (; i + 16 <= rowBytes; i += 16)
+			{
+				__m128i x = _mm_loadu_si128((const __m128i*)(row + i));
+				__m128i b = _mm_loadu_si128((const __m128i*)(prev + i));
+				_mm_storeu_si128((__m128i*)(dst + i), _mm_sub_epi8(x, b));
+			}
+#endif
+
+			for (; i < rowBytes; i++)
+				dst[i] = (byte)(row[i] - prev[i]);
+		}
+
+		void FilterAverage(const byte* row, const byte* prev, int32 rowBytes, int32 bpp, byte* dst)
+		{
+			int32 i = 0;
+			for (; i < bpp; i++)
+				dst[i] = (byte)(row[i] - (prev[i] >> 1));
+
+#ifdef PNGWRITER_SSE2
+			const __m128i one = _mm_set1_epi8(1);
+
+			for (; i + 16 <= rowBytes; i += 16)
+			{
+				__m128i x = _mm_loadu_si128((const __m128i*)(row + i));
+				__m128i a = _mm_loadu_si128((const __m128i*)(row + i - bpp));
+				__m128i b = _mm_loadu_si128((const __m128i*)(prev + i));
+
+				// _mm_avg_epu8 rounds up, the filter rounds down
+				__m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+				_mm_storeu_si128((__m128i*)(dst + i), _mm_sub_epi8(x, avg));
+			}
+#endif
+
+			for (; i < rowBytes; i++)
+				dst[i] = (byte)(row[i] - ((row[i - bpp] + prev[i]) >> 1));
+		}
+
+#ifdef PNGWRITER_SSE2
+		/** Paeth predictions of 8 bytes widened to 16 bits */
+		__m128i PaethPredictor8(__m128i a, __m128i b, __m128i c)
+		{
+			const __m128i zero = _mm_setzero_si128();
+
+			// with p = a + b - c, |p - a| = |b - c|, |p - b| = |a - c| and |p - c| = |b - c + a - c|
+			__m128i bc = _mm_sub_epi16(b, c);
+			__m128i ac = _mm_sub_epi16(a, c);
+
+			__m128i pa = _mm_max_epi16(bc, _mm_sub_epi16(zero, bc));
+			__m128i pb = _mm_max_epi16(ac, _mm_sub_epi16(zero, ac));
+			__m128i abc = _mm_add_epi16(bc, ac);
+			__m128i pc = _mm_max_epi16(abc, _mm_sub_epi16(zero, abc));
+
+			__m128i notA = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+			__m128i notB = _mm_cmpgt_epi16(pb, pc);
+
+			__m128i bOrC = _mm_or_si128(_mm_andnot_si128(notB, b), _mm_and_si128(notB, c));
+			return _mm_or_si128(_mm_andnot_si128(notA, a), _mm_and_si128(notA, bOrC));
+		}
+#endif
+
+		void FilterPaeth(const byte* row, const byte* prev, int32 rowBytes, int32 bpp, byte* dst)
+		{
+			// with nothing on the left the prediction is the byte above
+			int32 i = 0;
+			for (; i < bpp; i++)
+				dst[i] = (byte)(row[i] - prev[i]);
+
+#ifdef PNGWRITER_SSE2
+			const __m128i zero = _mm_setzero_si128();
+
+			for (; i + 16 <= rowBytes; i += 16)
+			{
+				__m128i x = _mm_loadu_si128((const __m128i*)(row + i));
+				__m128i a = _mm_loadu_si128((const __m128i*)(row + i - bpp));
+				__m128i b = _mm_loadu_si128((const __m128i*)(prev + i));
+				__m128i c = _mm_loadu_si128((const __m128i*)(prev + i - bpp));
+
+				__m128i lo = PaethPredictor8(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero));
+				__m128i hi = PaethPredictor8(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero));
+
+				_mm_storeu_si128((__m128i*)(dst + i), _mm_sub_epi8(x, _mm_packus_epi16(lo, hi)));
+			}
+#endif
+
+			for (; i < rowBytes; i++)
+				dst[i] = (byte)(row[i] - PaethPredictor(row[i - bpp], prev[i], prev[i - bpp]));
+		}
+
+		void ApplyFilter(FilterType type, const byte* row, const byte* prev, int32 rowBytes, int32 bpp, byte* dst)
+		{
+			switch (type)
+			{
+				case FILTER_Sub: FilterSub(row, rowBytes, bpp, dst); break;
+				case FILTER_Up: FilterUp(row, prev, rowBytes, dst); break;
+				case FILTER_Average: FilterAverage(row, prev, rowBytes, bpp, dst); break;
+				case FILTER_Paeth: FilterPaeth(row, prev, rowBytes, bpp, dst); break;
+				default: memcpy(dst, row, rowBytes); break;
+			}
+		}
+
+		/** Sum of the filtered bytes taken as signed, the measure libpng picks filters by */
+		uint32 FilterCost(const byte* data, int32 count)
+		{
+			uint32 sum = 0;
+			int32 i = 0;
+
+#ifdef PNGWRITER_SSE2
+			// the magnitude of a signed byte is the smaller of it and its negation, unsigned
+			const __m128i zero = _mm_setzero_si128();
+			__m128i sums = zero;
+
+			for (; i + 16 <= count; i += 16)
+			{
+				__m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+				__m128i magnitude = _mm_min_epu8(v, _mm_sub_epi8(zero, v));
+				sums = _mm_add_epi64(sums, _mm_sad_epu8(magnitude, zero));
+			}
+
+			sum = (uint32)_mm_cvtsi128_si32(sums) + (uint32)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+#endif
+
+			for (; i < count; i++)
+				sum += data[i] < 128 ? data[i] : 256 - data[i];
+			return sum;
+		}
+
+		/**
+		 *  Filters one row with the filter of the smallest cost among the ones
+		 *  the profile tries. Writes the filter type and the row to dst.
+		 *  scratch holds a row.
+		 */
+		void FilterRow(const ProfileSettings& profile, const byte* row, const byte* prev, int32 rowBytes, int32 bpp, byte* dst, byte* scratch)
+		{
+			if (profile.repeatedRowFastPath && memcmp(row, prev, rowBytes) == 0)
+			{
+				dst[0] = FILTER_Up;
+				memset(dst + 1, 0, rowBytes);
+				return;
+			}
+
+			// the best so far is kept in dst, candidates are made in scratch
+			byte* best = dst + 1;
+			byte* candidate = scratch;
+
+			dst[0] = FILTER_None;
+			memcpy(best, row, rowBytes);
+			uint32 bestCost = FilterCost(row, rowBytes);
+
+			for (int32 f = 0; f < profile.filterCount && bestCost > 0; f++)
+			{
+				ApplyFilter(profile.filters[f], row, prev, rowBytes, bpp, candidate);
+
+				uint32 cost = FilterCost(candidate, rowBytes);
+				if (cost < bestCost)
+				{
+					dst[0] = (byte)profile.filters[f];
+					bestCost = cost;
+					std::swap(best, candidate);
+				}
+			}
+
+			if (best != dst + 1)
+				memcpy(dst + 1, best, rowBytes);
+		}
+	}
+
+	PaletteQuantizer::PaletteQuantizer(const List<ColorValue>& colors)
+	{
+		for (ColorValue cv : colors)
+		{
+			uint32 c = ToPaletteColor(cv);
+			if (!m_palette.Contains(c) && m_palette.getCount() < MaxColors)
+				m_palette.Add(c);
+		}
+
+		// blends between every pair, so anti-aliased edges find a close shade
+		int32 baseCount = m_palette.getCount();
+		int32 pairCount = baseCount * (baseCount - 1) / 2;
+		int32 steps = pairCount > 0 ? (MaxColors - baseCount) / pairCount : 0;
+
+		for (int32 i = 0; i < baseCount; i++)
+		{
+			for (int32 j = i + 1; j < baseCount; j++)
+			{
+				for (int32 s = 1; s <= steps; s++)
+				{
+					uint32 blend = 0;
+					for (int32 ch = 0; ch < 3; ch++)
+					{
+						int32 a = (m_palette[i] >> (ch * 8)) & 0xff;
+						int32 b = (m_palette[j] >> (ch * 8)) & 0xff;
+						int32 v = (a * (steps + 1 - s) + b * s + (steps + 1) / 2) / (steps + 1);
+						blend |= (uint32)v << (ch * 8);
+					}
+					m_palette.Add(blend);
+				}
+			}
+		}
+
+		// steps is rounded down, so the blends fit in what the colors leave.
+		// Indices are bytes, and a PLTE chunk holds no more entries.
+		assert(m_palette.getCount() <= MaxColors);
+
+		memset(m_tableKeys, 0xff, sizeof(m_tableKeys));
+	}
+
+	byte PaletteQuantizer::Map(uint32 rgba)
+	{
+		uint32 color = rgba & 0xffffff;
+
+		if (color == m_lastColor)
+			return m_lastIndex;
+
+		uint32 slot = (color * 2654435761u) >> (32 - TableBits);
+		while (m_tableKeys[slot] != EmptyKey)
+		{
+			if (m_tableKeys[slot] == color)
+			{
+				m_lastColor = color;
+				m_lastIndex = m_tableIndices[slot];
+				return m_lastIndex;
+			}
+			slot = (slot + 1) & (TableSize - 1);
+		}
+
+		byte index = FindNearest(color);
+
+		// kept at most half full so probes stay short. Past that, colors
+		// not seen yet are searched for every time.
+		if (m_tableCount < TableSize / 2)
+		{
+			m_tableKeys[slot] = color;
+			m_tableIndices[slot] = index;
+			m_tableCount++;
+		}
+
+		m_lastColor = color;
+		m_lastIndex = index;
+		return index;
+	}
+
+	byte PaletteQuantizer::FindNearest(uint32 color) const
+	{
+		int32 best = 0;
+		int32 bestDistance = INT32_MAX;
+
+		for (int32 i = 0; i < m_palette.getCount() && bestDistance > 0; i++)
+		{
+			int32 distance = 0;
+			for (int32 ch = 0; ch < 3; ch++)
+			{
+				int32 d = (int32)((color >> (ch * 8)) & 0xff) - (int32)((m_palette[i] >> (ch * 8)) & 0xff);
+				distance += d * d;
+			}
+
+			if (distance < bestDistance)
+			{
+				best = i;
+				bestDistance = distance;
+			}
+		}
+		return (byte)best;
+	}
+
+	uint32 PaletteQuantizer::ToPaletteColor(ColorValue cv)
+	{
+		// R, G, B byte order, like the pixels
+		return ((cv >> 16) & 0xff) | (cv & 0xff00) | ((cv & 0xff) << 16);
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	ParallelPngWriter::ParallelPngWriter(int32 width, int32 height, FileOutStream& strm, WorkerPool& pool, PngProfile profile, PngColorMode colorMode, PaletteQuantizer* quantizer)
+		: m_stream(strm), m_pool(pool), m_profile(profile), m_colorMode(colorMode), m_quantizer(quantizer), m_width(width), m_height(height)
+	{
+		assert(colorMode != PNGCOL_Palette || quantizer);
+
+		const ProfileSettings& settings = Profiles[profile];
+
+		static const int32 BytesPerPixel[] = { 4, 3, 1 };
+		m_bytesPerPixel = BytesPerPixel[colorMode];
+
+		m_rowBytes = width * m_bytesPerPixel;
+		m_bandRows = Math::Max(1, BandTargetBytes / (m_rowBytes + 1));
+
+		// two bands per thread in a batch, so uneven bands even out
+		int32 bandCount = pool.getThreadCount() * 2;
+		for (int32 i = 0; i < bandCount; i++)
+		{
+			Band* b = new Band();
+			b->zstrm = new z_stream();
+
+			int ret = deflateInit2(b->zstrm, settings.level, Z_DEFLATED, -15, 8, settings.strategy);
+			assert(ret == Z_OK);
+
+			m_bands.Add(b);
+		}
+
+		m_rows.ReserveDiscard(bandCount * m_bandRows * m_rowBytes);
+		m_previousRow.ReserveDiscard(m_rowBytes);
+		memset(m_previousRow.getElements(), 0, m_rowBytes);
+
+		m_adler = adler32(0, nullptr, 0);
+
+		m_stream.Write((const char*)PngSignature, sizeof(PngSignature));
+
+		byte header[13];
+		WriteUInt32BE(header, width);
+		WriteUInt32BE(header + 4, height);
+		header[8] = 8;			// bit depth
+		header[9] = ColorTypes[colorMode];
+		header[10] = 0;			// deflate
+		header[11] = 0;			// adaptive filtering
+		header[12] = 0;			// no interlace
+		WriteChunk("IHDR", header, sizeof(header));
+
+		if (colorMode == PNGCOL_Palette)
+		{
+			const List<uint32>& palette = quantizer->getPalette();
+
+			List<byte> entries;
+			for (uint32 c : palette)
+			{
+				entries.Add((byte)c);
+				entries.Add((byte)(c >> 8));
+				entries.Add((byte)(c >> 16));
+			}
+			WriteChunk("PLTE", entries.getElements(), entries.getCount());
+		}
+	}
+
+	ParallelPngWriter::~ParallelPngWriter()
+	{
+		for (Band* b : m_bands)
+		{
+			deflateEnd(b->zstrm);
+			delete b->zstrm;
+			delete b;
+		}
+		m_bands.Clear();
+	}
+
+	void ParallelPngWriter::WriteRows(const byte* rows, int32 pitch, int32 count)
+	{
+		assert(m_writtenRows + m_heldRows + count <= m_height);
+
+		int32 batchRows = m_bands.getCount() * m_bandRows;
+
+		for (int32 i = 0; i < count; i++)
+		{
+			ConvertRow(rows + i * pitch, m_rows.getElements() + m_heldRows * m_rowBytes);
+			m_heldRows++;
+
+			// the last rows wait for Finish(), so the stream always ends in a band
+			// and the file is the same whatever the batch size
+			if (m_heldRows == batchRows && m_writtenRows + m_heldRows < m_height)
+				CompressBatch(false);
+		}
+	}
+
+	void ParallelPngWriter::Finish()
+	{
+		assert(!m_finished);
+		assert(m_writtenRows + m_heldRows == m_height);
+
+		CompressBatch(true);
+		WriteChunk("IEND", nullptr, 0);
+
+		m_finished = true;
+	}
+
+	void ParallelPngWriter::ConvertRow(const byte* src, byte* dst)
+	{
+		switch (m_colorMode)
+		{
+			case PNGCOL_RGBA:
+				memcpy(dst, src, m_rowBytes);
+				break;
+			case PNGCOL_RGB:
+				PackRowRGB(src, dst, m_width);
+				break;
+			case PNGCOL_Palette:
+				for (int32 x = 0; x < m_width; x++)
+				{
+					uint32 rgba;
+					memcpy(&rgba, src + x * 4, sizeof(rgba));
+					dst[x] = m_quantizer->Map(rgba);
+				}
+				break;
+		}
+	}
+
+	void ParallelPngWriter::CompressBatch(bool last)
+	{
+		int32 bandCount = (m_heldRows + m_bandRows - 1) / m_bandRows;
+
+		m_pool.ParallelFor(bandCount, [this](int32 i) { FilterBand(i); });
+		m_pool.ParallelFor(bandCount, [this, bandCount, last](int32 i) { DeflateBand(i, last && i == bandCount - 1); });
+
+		for (int32 i = 0; i < bandCount; i++)
+		{
+			const Band& b = *m_bands[i];
+			m_adler = adler32_combine(m_adler, b.adler, b.filtered.getCount());
+		}
+
+		if (last)
+		{
+			List<byte> ending;
+
+			if (!m_headerWritten && bandCount == 0)
+			{
+				byte header[2];
+				MakeZlibHeader(Profiles[m_profile].level, Profiles[m_profile].strategy, header);
+				ending.Add(header[0]);
+				ending.Add(header[1]);
+			}
+			if (bandCount == 0)
+			{
+				// an empty final block
+				ending.Add(0x03);
+				ending.Add(0x00);
+			}
+
+			byte adler[4];
+			WriteUInt32BE(adler, m_adler);
+			for (byte a : adler)
+				ending.Add(a);
+
+			if (bandCount > 0)
+				m_bands[bandCount - 1]->compressed.AddList(ending);
+			else
+				WriteChunk("IDAT", ending.getElements(), ending.getCount());
+		}
+
+		for (int32 i = 0; i < bandCount; i++)
+		{
+			const Band& b = *m_bands[i];
+			WriteChunk("IDAT", b.compressed.getElements(), b.compressed.getCount());
+		}
+
+		if (bandCount > 0)
+		{
+			m_headerWritten = true;
+
+			List<byte> history;
+			GatherWindow(bandCount, history);
+			m_history = history;
+
+			memcpy(m_previousRow.getElements(), m_rows.getElements() + (m_heldRows - 1) * m_rowBytes, m_rowBytes);
+		}
+
+		m_writtenRows += m_heldRows;
+		m_heldRows = 0;
+	}
+
+	void ParallelPngWriter::FilterBand(int32 index)
+	{
+		Band& b = *m_bands[index];
+
+		int32 firstRow = index * m_bandRows;
+		int32 rowCount = Math::Min(m_bandRows, m_heldRows - firstRow);
+
+		b.filtered.ReserveDiscard(rowCount * (m_rowBytes + 1));
+
+		List<byte> scratch(m_rowBytes);
+		scratch.ReserveDiscard(m_rowBytes);
+
+		for (int32 r = 0; r < rowCount; r++)
+		{
+			int32 y = firstRow + r;
+			const byte* row = m_rows.getElements() + y * m_rowBytes;
+			const byte* prev = y > 0 ? row - m_rowBytes : m_previousRow.getElements();
+
+			FilterRow(Profiles[m_profile], row, prev, m_rowBytes, m_bytesPerPixel, b.filtered.getElements() + r * (m_rowBytes + 1), scratch.getElements());
+		}
+
+		b.adler = adler32(1, b.filtered.getElements(), b.filtered.getCount());
+	}
+
+	void ParallelPngWriter::DeflateBand(int32 index, bool last)
+	{
+		Band& b = *m_bands[index];
+		z_stream* zs = b.zstrm;
+
+		GatherWindow(index, b.dictionary);
+
+		deflateReset(zs);
+		if (b.dictionary.getCount() > 0)
+			deflateSetDictionary(zs, b.dictionary.getElements(), b.dictionary.getCount());
+
+		b.compressed.Clear();
+		if (index == 0 && !m_headerWritten)
+		{
+			byte header[2];
+			MakeZlibHeader(Profiles[m_profile].level, Profiles[m_profile].strategy, header);
+			b.compressed.Add(header[0]);
+			b.compressed.Add(header[1]);
+		}
+
+		zs->next_in = b.filtered.getElements();
+		zs->avail_in = b.filtered.getCount();
+
+		// a sync flush ends the band on a byte boundary without ending the stream
+		int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+
+		for (;;)
+		{
+			int32 offset = b.compressed.getCount();
+			int32 space = (int32)deflateBound(zs, zs->avail_in) + 16;
+
+			b.compressed.Reserve(offset + space);
+			zs->next_out = b.compressed.getElements() + offset;
+			zs->avail_out = space;
+
+			int ret = deflate(zs, flush);
+			assert(ret != Z_STREAM_ERROR);
+
+			b.compressed.Reserve(offset + space - zs->avail_out);
+
+			if (last ? ret == Z_STREAM_END : (zs->avail_in == 0 && zs->avail_out > 0))
+				break;
+		}
+	}
+
+	void ParallelPngWriter::GatherWindow(int32 bandIndex, List<byte>& result) const
+	{
+		// walk back over the bands before it until the window is covered
+		int32 needed = WindowSize;
+		int32 first = bandIndex;
+		while (first > 0 && needed > 0)
+		{
+			first--;
+			needed -= m_bands[first]->filtered.getCount();
+		}
+
+		int32 fromHistory = needed > 0 ? Math::Min(needed, m_history.getCount()) : 0;
+
+		result.Reserve(fromHistory);
+		memcpy(result.getElements(), m_history.getElements() + m_history.getCount() - fromHistory, fromHistory);
+
+		for (int32 i = first; i < bandIndex; i++)
+		{
+			const List<byte>& f = m_bands[i]->filtered;
+			int32 skip = (i == first && needed < 0) ? -needed : 0;
+
+			int32 offset = result.getCount();
+			result.Reserve(offset + f.getCount() - skip);
+			memcpy(result.getElements() + offset, f.getElements() + skip, f.getCount() - skip);
+		}
+	}
+
+	void ParallelPngWriter::WriteChunk(const char* type, const byte* data, int32 length)
+	{
+		byte lengthBytes[4];
+		WriteUInt32BE(lengthBytes, length);
+
+		uLong crc = crc32(0, (const Bytef*)type, 4);
+		if (length > 0)
+			crc = crc32(crc, data, length);
+
+		byte crcBytes[4];
+		WriteUInt32BE(crcBytes, crc);
+
+		m_stream.Write((const char*)lengthBytes, 4);
+		m_stream.Write(type, 4);
+		if (length > 0)
+			m_stream.Write((const char*)data, length);
+		m_stream.Write((const char*)crcBytes, 4);
+	}
+}
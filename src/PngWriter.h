@@ -0,0 +1,141 @@
+#pragma once
+
+#include "SRCommon.h"
+
+struct z_stream_s;
+
+namespace SR
+{
+	class WorkerPool;
+
+	enum PngProfile
+	{
+		/** Tries every filter on each row and deflates at the default level, like libpng */
+		PNGPROF_General,
+		/**
+		 *  For images of large single color areas, like exports. Tries fewer
+		 *  filters, skips rows equal to the one above and deflates with run
+		 *  length matches only. About twice as fast as PNGPROF_General on an
+		 *  export, for a file about 6% larger.
+		 */
+		PNGPROF_FlatColor
+	};
+
+	enum PngColorMode
+	{
+		PNGCOL_RGBA,
+		/** Drops alpha, for opaque images */
+		PNGCOL_RGB,
+		/** 8-bit indices into a palette from a PaletteQuantizer, alpha is dropped */
+		PNGCOL_Palette
+	};
+
+	/**
+	 *  Maps pixels to a palette of at most 256 colors: the given colors and
+	 *  blends between each pair of them. Colors seen before are found in a
+	 *  hash table, new ones take the nearest palette entry and are added.
+	 *  Not thread safe.
+	 */
+	class PaletteQuantizer
+	{
+	public:
+		static const int32 MaxColors = 256;
+
+		explicit PaletteQuantizer(const List<ColorValue>& colors);
+
+		/** Takes a pixel in R, G, B, A byte order */
+		byte Map(uint32 rgba);
+
+		/** Entries in R, G, B byte order */
+		const List<uint32>& getPalette() const { return m_palette; }
+
+	private:
+		static const int32 TableBits = 14;
+		static const int32 TableSize = 1 << TableBits;
+		static const uint32 EmptyKey = 0xffffffff;
+
+		byte FindNearest(uint32 color) const;
+		static uint32 ToPaletteColor(ColorValue cv);
+
+		List<uint32> m_palette;
+
+		uint32 m_tableKeys[TableSize];
+		byte m_tableIndices[TableSize];
+		int32 m_tableCount = 0;
+
+		/** flat areas map the same color over and over */
+		uint32 m_lastColor = EmptyKey;
+		byte m_lastIndex = 0;
+	};
+
+	/**
+	 *  Writes an 8-bit PNG from RGBA rows given top down, filtering and
+	 *  deflating bands of rows in parallel on a worker pool. Rows are
+	 *  converted to the color mode as they are taken in.
+	 *
+	 *  Each band is compressed on its own with the 32KB of data before it as
+	 *  the dictionary, and flushed to a byte boundary, so the bands join into
+	 *  the single zlib stream of the IDAT chunks. The stream's Adler-32 is
+	 *  combined from the bands'. Band boundaries do not depend on the pool,
+	 *  so neither does the file.
+	 */
+	class ParallelPngWriter
+	{
+	public:
+		/** The quantizer is needed for PNGCOL_Palette, and used by the writer until it is deleted */
+		ParallelPngWriter(int32 width, int32 height, FileOutStream& strm, WorkerPool& pool,
+			PngProfile profile = PNGPROF_General, PngColorMode colorMode = PNGCOL_RGBA, PaletteQuantizer* quantizer = nullptr);
+		~ParallelPngWriter();
+
+		/** Takes a copy of rows in R, G, B, A byte order */
+		void WriteRows(const byte* rows, int32 pitch, int32 count);
+
+		/** Compresses the rows still held and writes the end of the file, which is incomplete without it. */
+		void Finish();
+
+	private:
+		struct Band
+		{
+			z_stream_s* zstrm = nullptr;
+
+			List<byte> filtered;			/** the rows with their filter type bytes */
+			List<byte> dictionary;
+			List<byte> compressed;
+			uint32 adler = 1;
+		};
+
+		void ConvertRow(const byte* src, byte* dst);
+		void CompressBatch(bool last);
+		void FilterBand(int32 index);
+		void DeflateBand(int32 index, bool last);
+
+		/** The last 32KB of filtered data before the given band of the batch */
+		void GatherWindow(int32 bandIndex, List<byte>& result) const;
+
+		void WriteChunk(const char* type, const byte* data, int32 length);
+
+		FileOutStream& m_stream;
+		WorkerPool& m_pool;
+		PngProfile m_profile;
+		PngColorMode m_colorMode;
+		PaletteQuantizer* m_quantizer;
+
+		int32 m_width;
+		int32 m_height;
+		int32 m_bytesPerPixel;
+		int32 m_rowBytes;
+		int32 m_bandRows;
+
+		List<byte> m_rows;					/** rows held for the next batch of bands */
+		int32 m_heldRows = 0;
+		int32 m_writtenRows = 0;
+
+		List<byte> m_previousRow;			/** the row above the first held one, zeros at the top */
+		List<byte> m_history;				/** the filtered data before the held rows, up to the window size */
+
+		List<Band*> m_bands;
+		uint32 m_adler;
+		bool m_headerWritten = false;
+		bool m_finished = false;
+	};
+}
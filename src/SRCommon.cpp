@@ -1,5 +1,7 @@
 #include "SRCommon.h"
 
+#include <Windows.h>
+
 #pragma comment(lib, "Apoc3D.lib")
 #pragma comment(lib, "Apoc3D.D3D9RenderSystem.lib")
 #pragma comment(lib, "Apoc3D.WindowsInput.lib")
@@ -7,3 +9,24 @@
 
 #pragma comment(lib, "libpng16.lib")
 #pragma comment(lib, "zlib.lib")
+
+namespace SR
+{
+	bool PrepareDirectory(const String& dir)
+	{
+		if (!File::DirectoryExists(dir) && !CreateDirectory(dir.c_str(), nullptr))
+			return false;
+
+		// the read-only attribute of a directory means nothing to Windows,
+		// so only creating a file tells whether the directory can be written
+		String probe = PathUtils::Combine(dir, L"~write_test.tmp");
+		HANDLE file = CreateFile(probe.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+			FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		CloseHandle(file);
+		return true;
+	}
+}
@@ -11,3 +11,12 @@ namespace SR
 
 using namespace Apoc3D;
 
+namespace SR
+{
+	/**
+	 *  Creates the directory if it is missing, then checks that files can
+	 *  be created in it. False if it can not be written to.
+	 */
+	bool PrepareDirectory(const String& dir);
+}
+
@@ -0,0 +1,816 @@
+#include "SoftwareCanvas.h"
+
+#include <cfloat>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define SOFTWARECANVAS_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define SOFTWARECANVAS_AVX2
+#include <immintrin.h>
+#endif
+
+namespace SR
+{
+	//////////////////////////////////////////////////////////////////////////
+	// BitmapFont
+
+	bool BitmapFont::Load(const ResourceLocation& rl)
+	{
+		const int32 FontID_V2 = (int32)0xffffff02;
+		const int32 Flag_Luminance = 1;
+
+		BinaryReader br(rl);
+
+		// only the layout written by the current font builder is known:
+		// id, flags, character count, then 4 line metrics
+		if (br.ReadInt32() != FontID_V2)
+			return false;
+
+		int32 flags = br.ReadInt32();
+		if (flags & ~Flag_Luminance)
+			return false;
+
+		int32 bytesPerPixel = (flags & Flag_Luminance) ? 2 : 1;
+
+		int32 charCount = br.ReadInt32();
+		m_glyphHeight = br.ReadSingle();
+		br.ReadSingle();
+		br.ReadSingle();
+		br.ReadSingle();
+
+		struct CharRecord
+		{
+			int32 Code;
+			Character Info;
+		};
+		List<CharRecord> chars(charCount);
+
+		int32 maxCode = 0;
+		for (int32 i = 0; i < charCount; i++)
+		{
+			CharRecord cr;
+			cr.Code = br.ReadInt32();
+			cr.Info.GlyphIndex = br.ReadInt32();
+			cr.Info.Left = br.ReadInt16();
+			cr.Info.Top = br.ReadInt16();
+			cr.Info.AdvanceX = br.ReadSingle();
+
+			if (cr.Code < 0 || cr.Code > 0xffff)
+				return false;
+
+			maxCode = Math::Max(maxCode, cr.Code);
+			chars.Add(cr);
+		}
+
+		m_characters.ReserveDiscard(maxCode + 1);
+		for (const CharRecord& cr : chars)
+			m_characters[cr.Code] = cr.Info;
+
+		int32 glyphCount = br.ReadInt32();
+
+		List<int64> fileOffsets(glyphCount);
+		m_glyphs.ReserveDiscard(glyphCount);
+
+		int32 dataSize = 0;
+		for (int32 i = 0; i < glyphCount; i++)
+		{
+			int32 index = br.ReadInt32();
+			if (index < 0 || index >= glyphCount)
+				return false;
+
+			Glyph& g = m_glyphs[index];
+			g.Width = br.ReadInt32();
+			g.Height = br.ReadInt32();
+			g.DataOffset = dataSize;
+
+			fileOffsets.Add(br.ReadInt64());
+			dataSize += g.Width * g.Height * 2;
+		}
+
+		for (const Character& c : m_characters)
+		{
+			if (c.GlyphIndex >= glyphCount)
+				return false;
+		}
+
+		// glyph pixels are kept as luminance/alpha pairs
+		m_glyphData.ReserveDiscard(dataSize);
+
+		Stream* strm = br.getBaseStream();
+		List<byte> buffer;
+		for (int32 i = 0; i < glyphCount; i++)
+		{
+			Glyph& g = m_glyphs[i];
+			int32 pixelCount = g.Width * g.Height;
+			byte* dst = m_glyphData.getElements() + g.DataOffset;
+
+			buffer.ReserveDiscard(pixelCount * bytesPerPixel);
+
+			strm->Seek(fileOffsets[i], SeekMode::Begin);
+			if (br.ReadBytes((char*)buffer.getElements(), pixelCount * bytesPerPixel) != pixelCount * bytesPerPixel)
+				return false;
+
+			for (int32 j = 0; j < pixelCount; j++)
+			{
+				dst[j * 2] = bytesPerPixel == 2 ? buffer[j * 2] : 0xff;
+				dst[j * 2 + 1] = buffer[j * bytesPerPixel + bytesPerPixel - 1];
+			}
+		}
+
+		return true;
+	}
+
+	const BitmapFont::Character* BitmapFont::getCharacter(int32 ch) const
+	{
+		if (ch < 0 || ch >= m_characters.getCount())
+			return nullptr;
+
+		const Character& c = m_characters[ch];
+		return c.GlyphIndex >= 0 ? &c : nullptr;
+	}
+
+	Point BitmapFont::MeasureString(const String& text) const
+	{
+		float width = 0;
+		for (size_t i = 0; i < text.size(); i++)
+		{
+			const Character* c = getCharacter(text[i]);
+			if (c)
+				width += c->AdvanceX;
+		}
+
+		return Point((int32)ceilf(width), (int32)ceilf(m_glyphHeight));
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// SoftwareCanvas
+
+	namespace
+	{
+		const int32 CoverageChunk = 64;
+
+		// 0xAARRGGBB to R, G, B, A in memory
+		uint32 ToRGBA(ColorValue c)
+		{
+			return (c & 0xff00ff00) | ((c >> 16) & 0xff) | ((c & 0xff) << 16);
+		}
+
+		// x / 255, rounded, for x in [0, 255 * 255]
+		uint32 Div255(uint32 x)
+		{
+			x += 128;
+			return (x + (x >> 8)) >> 8;
+		}
+
+		uint32 ToPremultipliedRGBA(ColorValue c)
+		{
+			uint32 alpha = c >> 24;
+			uint32 result = alpha << 24;
+			for (int32 ch = 0; ch < 3; ch++)
+				result |= Div255(((c >> (16 - ch * 8)) & 0xff) * alpha) << (ch * 8);
+			return result;
+		}
+
+		/**
+		 *  Blends a straight alpha color over a premultiplied dst. srcTerm holds
+		 *  the color channels times alpha and 255 times alpha for the alpha
+		 *  channel, so an opaque destination stays opaque.
+		 */
+		uint32 BlendPixel(uint32 dst, const uint32 srcTerm[4], uint32 invAlpha)
+		{
+			uint32 result = 0;
+			for (int32 c = 0; c < 4; c++)
+			{
+				uint32 d = (dst >> (c * 8)) & 0xff;
+				result |= Div255(srcTerm[c] + d * invAlpha) << (c * 8);
+			}
+			return result;
+		}
+	}
+
+	void FillSpan(uint32* dst, int32 count, uint32 rgba)
+	{
+		int32 i = 0;
+
+#ifdef SOFTWARECANVAS_SSE2
+		__m128i v = _mm_set1_epi32((int)rgba);
+		for (; i + 4 <= count; i += 4)
+			_mm_storeu_si128((__m128i*)(dst + i), v);
+#endif
+
+		for (; i < count; i++)
+			dst[i] = rgba;
+	}
+
+	void BlendSpan(uint32* dst, int32 count, uint32 rgba)
+	{
+		uint32 alpha = rgba >> 24;
+		uint32 invAlpha = 255 - alpha;
+
+		uint32 srcTerm[4];
+		for (int32 c = 0; c < 3; c++)
+			srcTerm[c] = ((rgba >> (c * 8)) & 0xff) * alpha;
+		srcTerm[3] = 255 * alpha;
+
+		int32 i = 0;
+
+#ifdef SOFTWARECANVAS_SSE2
+		// two pixels of 4 16-bit channels per register
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i src = _mm_setr_epi16(
+			(short)srcTerm[0], (short)srcTerm[1], (short)srcTerm[2], (short)srcTerm[3],
+			(short)srcTerm[0], (short)srcTerm[1], (short)srcTerm[2], (short)srcTerm[3]);
+		const __m128i inv = _mm_set1_epi16((short)invAlpha);
+		const __m128i bias = _mm_set1_epi16(128);
+
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+
+			__m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), inv), src), bias);
+			__m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), inv), src), bias);
+
+			lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+			hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+		}
+#endif
+
+		for (; i < count; i++)
+			dst[i] = BlendPixel(dst[i], srcTerm, invAlpha);
+	}
+
+	void BlendCoverageSpan(uint32* dst, const byte* coverage, int32 count, uint32 rgba)
+	{
+		uint32 alpha = rgba >> 24;
+
+		uint32 color[4];
+		for (int32 c = 0; c < 3; c++)
+			color[c] = (rgba >> (c * 8)) & 0xff;
+		color[3] = 255;
+
+		int32 i = 0;
+
+#ifdef SOFTWARECANVAS_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i src = _mm_setr_epi16(
+			(short)color[0], (short)color[1], (short)color[2], (short)color[3],
+			(short)color[0], (short)color[1], (short)color[2], (short)color[3]);
+		const __m128i srcAlpha = _mm_set1_epi16((short)alpha);
+		const __m128i full = _mm_set1_epi16(255);
+		const __m128i bias = _mm_set1_epi16(128);
+
+		for (; i + 4 <= count; i += 4)
+		{
+			int32 cov4;
+			memcpy(&cov4, coverage + i, sizeof(cov4));
+			if (cov4 == 0)
+				continue;
+
+			// the alpha of each of the 4 pixels, then spread over its 4 channels
+			__m128i a = _mm_unpacklo_epi8(_mm_cvtsi32_si128(cov4), zero);
+			a = _mm_add_epi16(_mm_mullo_epi16(a, srcAlpha), bias);
+			a = _mm_srli_epi16(_mm_add_epi16(a, _mm_srli_epi16(a, 8)), 8);
+			a = _mm_unpacklo_epi16(a, a);
+
+			__m128i aLo = _mm_unpacklo_epi32(a, a);
+			__m128i aHi = _mm_unpackhi_epi32(a, a);
+
+			__m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+			__m128i dLo = _mm_unpacklo_epi8(d, zero);
+			__m128i dHi = _mm_unpackhi_epi8(d, zero);
+
+			__m128i lo = _mm_add_epi16(_mm_mullo_epi16(src, aLo), _mm_mullo_epi16(dLo, _mm_sub_epi16(full, aLo)));
+			__m128i hi = _mm_add_epi16(_mm_mullo_epi16(src, aHi), _mm_mullo_epi16(dHi, _mm_sub_epi16(full, aHi)));
+			lo = _mm_add_epi16(lo, bias);
+			hi = _mm_add_epi16(hi, bias);
+
+			lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+			hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+		}
+#endif
+
+		for (; i < count; i++)
+		{
+			uint32 a = Div255(alpha * coverage[i]);
+			if (a == 0)
+				continue;
+
+			uint32 srcTerm[4];
+			for (int32 c = 0; c < 4; c++)
+				srcTerm[c] = color[c] * a;
+
+			dst[i] = BlendPixel(dst[i], srcTerm, 255 - a);
+		}
+	}
+
+	namespace
+	{
+		/** A rounded rect prepared for distance evaluation */
+		struct RoundedBox
+		{
+			float CenterX;
+			float CenterY;
+			float InnerHalfWidth;			/** half extents less the radius */
+			float InnerHalfHeight;
+			float Radius;
+
+			RoundedBox(const Rectangle& rect, float radius)
+			{
+				float halfWidth = rect.Width * 0.5f;
+				float halfHeight = rect.Height * 0.5f;
+
+				Radius = Math::Max(0.0f, Math::Min(radius, Math::Min(halfWidth, halfHeight)));
+				CenterX = rect.X + halfWidth;
+				CenterY = rect.Y + halfHeight;
+				InnerHalfWidth = halfWidth - Radius;
+				InnerHalfHeight = halfHeight - Radius;
+			}
+		};
+
+		/**
+		 *  Signed distance from the centres of pixels [x0, x0 + count) on row y
+		 *  to the edge of the box, negative inside. Pixel centres are at +0.5
+		 *  so that a box on whole pixels covers them exactly.
+		 */
+		void BoxDistance(const RoundedBox& box, int32 y, int32 x0, int32 count, float* dist)
+		{
+			float qy = fabsf(y + 0.5f - box.CenterY) - box.InnerHalfHeight;
+			float qyOut = Math::Max(qy, 0.0f);
+			float px = x0 + 0.5f - box.CenterX;
+
+			int32 i = 0;
+
+#ifdef SOFTWARECANVAS_AVX2
+			{
+				const __m256 signMask = _mm256_set1_ps(-0.0f);
+				const __m256 zero = _mm256_setzero_ps();
+				const __m256 step = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+				const __m256 vqy = _mm256_set1_ps(qy);
+				const __m256 vqyOut2 = _mm256_set1_ps(qyOut * qyOut);
+				const __m256 inner = _mm256_set1_ps(box.InnerHalfWidth);
+				const __m256 radius = _mm256_set1_ps(box.Radius);
+
+				for (; i + 8 <= count; i += 8)
+				{
+					__m256 x = _mm256_add_ps(_mm256_set1_ps(px + i), step);
+					__m256 qx = _mm256_sub_ps(_mm256_andnot_ps(signMask, x), inner);
+					__m256 qxOut = _mm256_max_ps(qx, zero);
+
+					__m256 outside = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(qxOut, qxOut), vqyOut2));
+					__m256 inside = _mm256_min_ps(_mm256_max_ps(qx, vqy), zero);
+					_mm256_storeu_ps(dist + i, _mm256_sub_ps(_mm256_add_ps(outside, inside), radius));
+				}
+			}
+#endif
+
+#ifdef SOFTWARECANVAS_SSE2
+			{
+				const __m128 signMask = _mm_set1_ps(-0.0f);
+				const __m128 zero = _mm_setzero_ps();
+				const __m128 step = _mm_setr_ps(0, 1, 2, 3);
+				const __m128 vqy = _mm_set1_ps(qy);
+				const __m128 vqyOut2 = _mm_set1_ps(qyOut * qyOut);
+				const __m128 inner = _mm_set1_ps(box.InnerHalfWidth);
+				const __m128 radius = _mm_set1_ps(box.Radius);
+
+				for (; i + 4 <= count; i += 4)
+				{
+					__m128 x = _mm_add_ps(_mm_set1_ps(px + i), step);
+					__m128 qx = _mm_sub_ps(_mm_andnot_ps(signMask, x), inner);
+					__m128 qxOut = _mm_max_ps(qx, zero);
+
+					__m128 outside = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(qxOut, qxOut), vqyOut2));
+					__m128 inside = _mm_min_ps(_mm_max_ps(qx, vqy), zero);
+					_mm_storeu_ps(dist + i, _mm_sub_ps(_mm_add_ps(outside, inside), radius));
+				}
+			}
+#endif
+
+			for (; i < count; i++)
+			{
+				float qx = fabsf(px + i) - box.InnerHalfWidth;
+				float qxOut = Math::Max(qx, 0.0f);
+
+				float outside = sqrtf(qxOut * qxOut + qyOut * qyOut);
+				float inside = Math::Min(Math::Max(qx, qy), 0.0f);
+				dist[i] = outside + inside - box.Radius;
+			}
+		}
+
+		/**
+		 *  Coverage from 0 to 255 of the band from a distance field's edge to
+		 *  width inside it, taking a pixel as covered by 0.5 - distance.
+		 *  A solid shape is a band of FLT_MAX width.
+		 */
+		void BandCoverage(const float* dist, int32 count, float width, byte* coverage)
+		{
+			int32 i = 0;
+
+#ifdef SOFTWARECANVAS_AVX2
+			{
+				const __m256 zero = _mm256_setzero_ps();
+				const __m256 one = _mm256_set1_ps(1.0f);
+				const __m256 half = _mm256_set1_ps(0.5f);
+				const __m256 scale = _mm256_set1_ps(255.0f);
+				const __m256 vwidth = _mm256_set1_ps(width);
+
+				for (; i + 8 <= count; i += 8)
+				{
+					__m256 a = _mm256_sub_ps(half, _mm256_loadu_ps(dist + i));
+					__m256 outer = _mm256_min_ps(_mm256_max_ps(a, zero), one);
+					__m256 inner = _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(a, vwidth), zero), one);
+
+					__m256i c = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(outer, inner), scale), half));
+					__m128i c16 = _mm_packs_epi32(_mm256_castsi256_si128(c), _mm256_extracti128_si256(c, 1));
+					_mm_storel_epi64((__m128i*)(coverage + i), _mm_packus_epi16(c16, c16));
+				}
+			}
+#endif
+
+#ifdef SOFTWARECANVAS_SSE2
+			{
+				const __m128 zero = _mm_setzero_ps();
+				const __m128 one = _mm_set1_ps(1.0f);
+				const __m128 half = _mm_set1_ps(0.5f);
+				const __m128 scale = _mm_set1_ps(255.0f);
+				const __m128 vwidth = _mm_set1_ps(width);
+
+				for (; i + 4 <= count; i += 4)
+				{
+					__m128 a = _mm_sub_ps(half, _mm_loadu_ps(dist + i));
+					__m128 outer = _mm_min_ps(_mm_max_ps(a, zero), one);
+					__m128 inner = _mm_min_ps(_mm_max_ps(_mm_sub_ps(a, vwidth), zero), one);
+
+					__m128i c = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(outer, inner), scale), half));
+					c = _mm_packs_epi32(c, c);
+					int32 cov4 = _mm_cvtsi128_si32(_mm_packus_epi16(c, c));
+					memcpy(coverage + i, &cov4, sizeof(cov4));
+				}
+			}
+#endif
+
+			for (; i < count; i++)
+			{
+				float a = 0.5f - dist[i];
+				float outer = Math::Min(Math::Max(a, 0.0f), 1.0f);
+				float inner = Math::Min(Math::Max(a - width, 0.0f), 1.0f);
+				coverage[i] = (byte)(int32)((outer - inner) * 255.0f + 0.5f);
+			}
+		}
+
+		/**
+		 *  Where the horizontal line through y crosses a convex polygon, as
+		 *  the half open pixel range [x0, x1). Returns false if y misses it.
+		 */
+		bool PolygonSpan(const PointF* pts, int32 count, float y, int32& x0, int32& x1)
+		{
+			float left = FLT_MAX;
+			float right = -FLT_MAX;
+
+			for (int32 i = 0; i < count; i++)
+			{
+				const PointF& a = pts[i];
+				const PointF& b = pts[(i + 1) % count];
+
+				// half open in y, so shared vertices and flat edges count once
+				if ((a.Y <= y && y < b.Y) || (b.Y <= y && y < a.Y))
+				{
+					float x = a.X + (y - a.Y) * (b.X - a.X) / (b.Y - a.Y);
+					left = Math::Min(left, x);
+					right = Math::Max(right, x);
+				}
+			}
+
+			if (left > right)
+				return false;
+
+			x0 = (int32)ceilf(left);
+			x1 = (int32)ceilf(right);
+			return x0 < x1;
+		}
+
+		void PolygonBounds(const PointF* pts, int32 count, int32& y0, int32& y1)
+		{
+			float top = pts[0].Y;
+			float bottom = pts[0].Y;
+			for (int32 i = 1; i < count; i++)
+			{
+				top = Math::Min(top, pts[i].Y);
+				bottom = Math::Max(bottom, pts[i].Y);
+			}
+			y0 = (int32)ceilf(top);
+			y1 = (int32)ceilf(bottom);
+		}
+	}
+
+	SoftwareCanvas::SoftwareCanvas(int32 width, int32 height, const BitmapFont* font)
+		: m_width(width), m_height(height), m_viewportHeight(height), m_font(font)
+	{
+		m_pixels = new uint32[width * height];
+		memset(m_pixels, 0, width * height * sizeof(uint32));
+	}
+
+	SoftwareCanvas::~SoftwareCanvas()
+	{
+		delete[] m_pixels;
+	}
+
+	void SoftwareCanvas::Clear(ColorValue color)
+	{
+		FillSpan(m_pixels, m_width * m_height, ToPremultipliedRGBA(color));
+	}
+
+	void SoftwareCanvas::SetWindow(int32 top, int32 viewportHeight)
+	{
+		m_top = top;
+		m_viewportHeight = viewportHeight;
+	}
+
+	void SoftwareCanvas::Span(int32 y, int32 x0, int32 x1, uint32 rgba)
+	{
+		if (y < 0 || y >= m_height)
+			return;
+
+		x0 = Math::Max(x0, 0);
+		x1 = Math::Min(x1, m_width);
+		if (x0 >= x1)
+			return;
+
+		uint32* row = m_pixels + y * m_width;
+		if ((rgba >> 24) == 0xff)
+			FillSpan(row + x0, x1 - x0, rgba);
+		else if (rgba >> 24)
+			BlendSpan(row + x0, x1 - x0, rgba);
+	}
+
+	void SoftwareCanvas::FillPolygon(const PointF* pts, int32 count, uint32 rgba)
+	{
+		int32 y0, y1;
+		PolygonBounds(pts, count, y0, y1);
+
+		y0 = Math::Max(y0, 0);
+		y1 = Math::Min(y1, m_height);
+
+		for (int32 y = y0; y < y1; y++)
+		{
+			int32 x0, x1;
+			if (PolygonSpan(pts, count, (float)y, x0, x1))
+				Span(y, x0, x1, rgba);
+		}
+	}
+
+	void SoftwareCanvas::FillRect(const Rectangle& rect, ColorValue color)
+	{
+		uint32 rgba = ToRGBA(color);
+
+		int32 y0 = Math::Max(rect.Y - m_top, 0);
+		int32 y1 = Math::Min(rect.Y + rect.Height - m_top, m_height);
+		for (int32 y = y0; y < y1; y++)
+			Span(y, rect.X, rect.X + rect.Width, rgba);
+	}
+
+	void SoftwareCanvas::AxisLine(bool horizontal, int32 pos, int32 from, int32 to, float width, uint32 rgba)
+	{
+		// move the edges to where the Sprite's quad first covers a pixel centre,
+		// so whole widths land on whole pixels and only a fraction is blended
+		float lo = pos - width * 0.5f;
+		float hi = pos + width * 0.5f + (ceilf(lo) - lo);
+
+		int32 first = (int32)ceilf(lo);
+		int32 last = (int32)floorf(hi);
+
+		uint32 edgeAlpha = (uint32)Math::Round((hi - last) * (rgba >> 24));
+		uint32 edgeRgba = (rgba & 0xffffff) | (edgeAlpha << 24);
+
+		if (horizontal)
+		{
+			for (int32 y = first; y < last; y++)
+				Span(y, from, to, rgba);
+			Span(last, from, to, edgeRgba);
+		}
+		else
+		{
+			int32 y0 = Math::Max(from, 0);
+			int32 y1 = Math::Min(to, m_height);
+			for (int32 y = y0; y < y1; y++)
+			{
+				Span(y, first, last, rgba);
+				Span(y, last, last + 1, edgeRgba);
+			}
+		}
+	}
+
+	void SoftwareCanvas::DrawLine(const Point& start, const Point& end, ColorValue color, float width)
+	{
+		if (start.Y == end.Y)
+		{
+			AxisLine(true, start.Y - m_top, Math::Min(start.X, end.X), Math::Max(start.X, end.X), width, ToRGBA(color));
+			return;
+		}
+		if (start.X == end.X)
+		{
+			AxisLine(false, start.X, Math::Min(start.Y, end.Y) - m_top, Math::Max(start.Y, end.Y) - m_top, width, ToRGBA(color));
+			return;
+		}
+
+		// a butt capped line is a quad of the given width around it
+		float dx = (float)(end.X - start.X);
+		float dy = (float)(end.Y - start.Y);
+		float length = sqrtf(dx * dx + dy * dy);
+
+		float nx = -dy / length * width * 0.5f;
+		float ny = dx / length * width * 0.5f;
+
+		float startY = (float)(start.Y - m_top);
+		float endY = (float)(end.Y - m_top);
+
+		const PointF quad[4] =
+		{
+			PointF(start.X + nx, startY + ny),
+			PointF(end.X + nx, endY + ny),
+			PointF(end.X - nx, endY - ny),
+			PointF(start.X - nx, startY - ny),
+		};
+
+		FillPolygon(quad, 4, ToRGBA(color));
+	}
+
+	void SoftwareCanvas::RoundedRect(Rectangle rect, float cornerRadius, uint32 rgba, float borderWidth, float borderRadius, uint32 borderRgba)
+	{
+		bool hasFill = (rgba >> 24) != 0;
+		bool hasBorder = (borderRgba >> 24) != 0 && borderWidth > 0;
+		if (!hasFill && !hasBorder)
+			return;
+
+		rect.Y -= m_top;
+
+		int32 x0 = Math::Max(rect.X, 0);
+		int32 x1 = Math::Min(rect.X + rect.Width, m_width);
+		int32 y0 = Math::Max(rect.Y, 0);
+		int32 y1 = Math::Min(rect.Y + rect.Height, m_height);
+		if (x0 >= x1)
+			return;
+
+		RoundedBox fillBox(rect, cornerRadius);
+		RoundedBox borderBox(rect, borderRadius);
+
+		// this far in from the edges the fill is solid and the border has ended,
+		// so only the rows and columns within it need the distance field
+		float reach = Math::Max(fillBox.Radius, borderBox.Radius);
+		if (hasBorder)
+			reach = Math::Max(reach, borderWidth);
+		int32 band = (int32)ceilf(reach) + 1;
+
+		float dist[CoverageChunk];
+		byte coverage[CoverageChunk];
+
+		// fill and border are blended chunk by chunk while the pixels are in cache
+		auto shade = [&](int32 y, int32 from, int32 to)
+		{
+			uint32* row = m_pixels + y * m_width;
+
+			for (int32 x = from; x < to; x += CoverageChunk)
+			{
+				int32 count = Math::Min(CoverageChunk, to - x);
+
+				if (hasFill)
+				{
+					BoxDistance(fillBox, y, x, count, dist);
+					BandCoverage(dist, count, FLT_MAX, coverage);
+					BlendCoverageSpan(row + x, coverage, count, rgba);
+				}
+				if (hasBorder)
+				{
+					BoxDistance(borderBox, y, x, count, dist);
+					BandCoverage(dist, count, borderWidth, coverage);
+					BlendCoverageSpan(row + x, coverage, count, borderRgba);
+				}
+			}
+		};
+
+		// below and above the corners the distance only changes along x, so the
+		// coverage of the side columns is worked out once for all those rows
+		bool cacheSides = rect.Width > band * 2 && rect.Height > band * 2 && band <= CoverageChunk;
+
+		byte sideCoverage[2][2][CoverageChunk];
+		if (cacheSides)
+		{
+			for (int32 side = 0; side < 2; side++)
+			{
+				int32 x = side ? rect.X + rect.Width - band : rect.X;
+
+				BoxDistance(fillBox, rect.Y + band, x, band, dist);
+				BandCoverage(dist, band, FLT_MAX, sideCoverage[side][0]);
+
+				BoxDistance(borderBox, rect.Y + band, x, band, dist);
+				BandCoverage(dist, band, borderWidth, sideCoverage[side][1]);
+			}
+		}
+
+		auto blendSide = [&](int32 y, int32 side)
+		{
+			int32 x = side ? rect.X + rect.Width - band : rect.X;
+			int32 from = Math::Max(x, x0);
+			int32 to = Math::Min(x + band, x1);
+			if (from >= to)
+				return;
+
+			uint32* row = m_pixels + y * m_width;
+			if (hasFill)
+				BlendCoverageSpan(row + from, sideCoverage[side][0] + from - x, to - from, rgba);
+			if (hasBorder)
+				BlendCoverageSpan(row + from, sideCoverage[side][1] + from - x, to - from, borderRgba);
+		};
+
+		for (int32 y = y0; y < y1; y++)
+		{
+			bool edgeRow = y < rect.Y + band || y >= rect.Y + rect.Height - band;
+			if (edgeRow || !cacheSides)
+			{
+				shade(y, x0, x1);
+				continue;
+			}
+
+			blendSide(y, 0);
+			if (hasFill)
+				Span(y, rect.X + band, rect.X + rect.Width - band, rgba);
+			blendSide(y, 1);
+		}
+	}
+
+	void SoftwareCanvas::DrawRoundedRect(const Rectangle& rect, float cornerRadius, int32 div, ColorValue color)
+	{
+		RoundedRect(rect, cornerRadius, ToRGBA(color), 0, 0, 0);
+	}
+
+	void SoftwareCanvas::DrawRoundedRectBorder(const Rectangle& rect, float width, float cornerRadius, int32 div, ColorValue color)
+	{
+		RoundedRect(rect, 0, 0, width, cornerRadius, ToRGBA(color));
+	}
+
+	void SoftwareCanvas::DrawRoundedRectWithBorder(const Rectangle& rect, float cornerRadius, int32 div, ColorValue color,
+		float borderWidth, float borderRadius, ColorValue borderColor)
+	{
+		RoundedRect(rect, cornerRadius, ToRGBA(color), borderWidth, borderRadius, ToRGBA(borderColor));
+	}
+
+	Point SoftwareCanvas::MeasureString(const String& text)
+	{
+		return m_font->MeasureString(text);
+	}
+
+	void SoftwareCanvas::DrawString(const String& text, const Point& pos, ColorValue color)
+	{
+		uint32 tint = ToRGBA(color);
+		uint32 tintAlpha = tint >> 24;
+
+		float x = (float)pos.X;
+		for (size_t i = 0; i < text.size(); i++)
+		{
+			const BitmapFont::Character* c = m_font->getCharacter(text[i]);
+			if (c == nullptr)
+				continue;
+
+			const BitmapFont::Glyph& g = m_font->getGlyph(c->GlyphIndex);
+			const byte* src = m_font->getGlyphData(g);
+
+			int32 gx = (int32)x + c->Left;
+			int32 gy = pos.Y - m_top + c->Top;
+
+			int32 row0 = Math::Max(0, -gy);
+			int32 row1 = Math::Min(g.Height, m_height - gy);
+			int32 col0 = Math::Max(0, -gx);
+			int32 col1 = Math::Min(g.Width, m_width - gx);
+
+			for (int32 r = row0; r < row1; r++)
+			{
+				uint32* dst = m_pixels + (gy + r) * m_width + gx;
+				const byte* glyphRow = src + r * g.Width * 2;
+
+				for (int32 k = col0; k < col1; k++)
+				{
+					uint32 luminance = glyphRow[k * 2];
+					uint32 alpha = Div255(glyphRow[k * 2 + 1] * tintAlpha);
+					if (alpha == 0)
+						continue;
+
+					uint32 srcTerm[4];
+					for (int32 ch = 0; ch < 3; ch++)
+						srcTerm[ch] = Div255(((tint >> (ch * 8)) & 0xff) * luminance) * alpha;
+					srcTerm[3] = 255 * alpha;
+
+					dst[k] = BlendPixel(dst[k], srcTerm, 255 - alpha);
+				}
+			}
+
+			x += c->AdvanceX;
+		}
+	}
+}
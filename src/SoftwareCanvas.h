@@ -0,0 +1,120 @@
+#pragma once
+
+#include "Canvas.h"
+
+namespace SR
+{
+	/**
+	 *  The glyph bitmaps of an engine .fnt file, loaded whole into memory
+	 *  for SoftwareCanvas. Unlike Font it needs no render device.
+	 */
+	class BitmapFont
+	{
+	public:
+		struct Glyph
+		{
+			int32 Width = 0;
+			int32 Height = 0;
+			int32 DataOffset = 0;			/** into m_glyphData, Width * Height luminance/alpha pairs */
+		};
+
+		struct Character
+		{
+			int32 GlyphIndex = -1;
+			int16 Left = 0;
+			int16 Top = 0;
+			float AdvanceX = 0;
+		};
+
+		/** Returns false if the file is not in a supported format. */
+		bool Load(const ResourceLocation& rl);
+
+		Point MeasureString(const String& text) const;
+
+		const Character* getCharacter(int32 ch) const;
+		const Glyph& getGlyph(int32 index) const { return m_glyphs[index]; }
+		const byte* getGlyphData(const Glyph& g) const { return m_glyphData.getElements() + g.DataOffset; }
+
+		float getLineHeight() const { return m_glyphHeight; }
+
+	private:
+		float m_glyphHeight = 0;
+
+		List<Character> m_characters;			/** indexed by character code */
+		List<Glyph> m_glyphs;
+		List<byte> m_glyphData;
+	};
+
+	/** The span kernels SoftwareCanvas draws with, on its R, G, B, A pixels. Sets count pixels to rgba. */
+	void FillSpan(uint32* dst, int32 count, uint32 rgba);
+	/** Blends a straight alpha color over premultiplied pixels */
+	void BlendSpan(uint32* dst, int32 count, uint32 rgba);
+	/** Blends a color over dst with its alpha scaled by each pixel's coverage */
+	void BlendCoverageSpan(uint32* dst, const byte* coverage, int32 count, uint32 rgba);
+
+	/**
+	 *  Renders into 32-bit pixels in memory, with the bytes of each pixel in
+	 *  R, G, B, A order, so rows can be written to a PNG as they are.
+	 *  Pixels hold premultiplied alpha, which is the same as straight alpha
+	 *  over the opaque background the export clears to.
+	 *
+	 *  Rounded rects are anti-aliased from the coverage of their signed
+	 *  distance, so the corner division count is ignored. Axis aligned lines
+	 *  snap to whole pixels the way the Sprite's do and only a fractional
+	 *  width is blended into the edge row. Other lines are scan converted
+	 *  without anti-aliasing.
+	 */
+	class SoftwareCanvas : public Canvas
+	{
+	public:
+		SoftwareCanvas(int32 width, int32 height, const BitmapFont* font);
+		~SoftwareCanvas();
+
+		void Clear(ColorValue color);
+
+		/**
+		 *  Makes the pixels rows [top, top + height) of a taller viewport, so a
+		 *  frame can be rendered as strips. Drawing is in viewport coordinates.
+		 */
+		void SetWindow(int32 top, int32 viewportHeight);
+
+		virtual Size getSize() const override { return Size(m_width, m_viewportHeight); }
+		virtual Rectangle getVisibleArea() const override { return Rectangle(0, m_top, m_width, m_height); }
+
+		virtual void FillRect(const Rectangle& rect, ColorValue color) override;
+		virtual void DrawLine(const Point& start, const Point& end, ColorValue color, float width) override;
+		virtual void DrawRoundedRect(const Rectangle& rect, float cornerRadius, int32 div, ColorValue color) override;
+		virtual void DrawRoundedRectBorder(const Rectangle& rect, float width, float cornerRadius, int32 div, ColorValue color) override;
+		virtual void DrawRoundedRectWithBorder(const Rectangle& rect, float cornerRadius, int32 div, ColorValue color,
+			float borderWidth, float borderRadius, ColorValue borderColor) override;
+
+		virtual Point MeasureString(const String& text) override;
+		virtual void DrawString(const String& text, const Point& pos, ColorValue color) override;
+
+		const byte* getPixels() const { return (const byte*)m_pixels; }
+		const byte* getRow(int32 y) const { return (const byte*)(m_pixels + y * m_width); }
+		int32 getPitch() const { return m_width * sizeof(uint32); }
+
+	private:
+		/** Blends color over the pixels [x0, x1) of row y, clipped to the canvas */
+		void Span(int32 y, int32 x0, int32 x1, uint32 rgba);
+
+		/** Fills a convex polygon */
+		void FillPolygon(const PointF* pts, int32 count, uint32 rgba);
+
+		/** A line along a row or column, pos being the coordinate across it */
+		void AxisLine(bool horizontal, int32 pos, int32 from, int32 to, float width, uint32 rgba);
+
+		/** The fill and the border ring of a rounded rect, either of which can be transparent */
+		void RoundedRect(Rectangle rect, float cornerRadius, uint32 rgba, float borderWidth, float borderRadius, uint32 borderRgba);
+
+		int32 m_width;
+		int32 m_height;
+		uint32* m_pixels;
+
+		int32 m_top = 0;
+		int32 m_viewportHeight;
+
+		const BitmapFont* m_font;
+	};
+}
@@ -1,67 +1,162 @@
 #include "Song.h"
-#include "Library/MidiFile.h"
+#include "WorkerPool.h"
+#include "Canvas.h"
+#include "Library/MidiEventStore.h"
+
+#include <utility>
 
 namespace
 {
-	void base12ToBase7(int pitch, int& base7, int& accidental)
+	using namespace SR;
+
+	// white key and accidental of each pitch class, Eb and Bb are spelled as flats
+	constexpr int16 ChromaBase7[12] = { 0, 0, 1, 2, 2, 3, 3, 4, 4, 5, 6, 6 };
+	constexpr int16 ChromaAccidental[12] = { 0, 1, 0, -1, 0, 0, 1, 0, 1, 0, -1, 0 };
+
+	// pitch class of each white key
+	constexpr int16 Base7Chroma[7] = { 0, 2, 4, 5, 7, 9, 11 };
+
+	const wchar_t* const NoteNames[12] = { L"C", L"Db", L"D", L"Eb", L"E", L"F", L"F#", L"G", L"Ab", L"A", L"Bb", L"B" };
+
+	struct PitchLayout
 	{
-		int octave = pitch / 12;
-		int chroma = pitch % 12;
-
-		accidental = 0;
-
-		int output = 0;
-		switch (chroma)
-		{
-			case  0: output = 0; break; // C
-			case  1: output = 0; accidental = 1; break; // C#
-			case  2: output = 1; break; // D
-			case  3: output = 2; accidental = -1; break; // Eb
-			case  4: output = 2; break; // E
-			case  5: output = 3; break; // F
-			case  6: output = 3; accidental = 1; break; // F#
-			case  7: output = 4; break; // G
-			case  8: output = 4; accidental = 1; break; // G#
-			case  9: output = 5; break; // A
-			case 10: output = 6; accidental = -1; break; // Bb
-			case 11: output = 6; break; // B
-		}
-		base7 = output + 7 * octave;
+		int16 base7;		// white key column
+		int16 accidental;	// -1, 0 or 1, half a column left or right of the white key
+		int16 label;		// index into NoteNames
+	};
+
+	constexpr int32 ShiftCount = MaxPitchShift - MinPitchShift + 1;
+
+	constexpr PitchLayout MakePitchLayout(int32 pitch)
+	{
+		return { (int16)(pitch / 12 * 7 + ChromaBase7[pitch % 12]), ChromaAccidental[pitch % 12], (int16)(pitch % 12) };
 	}
 
-	int base7ToBase12(int base7, int accidental)
+	// entry i holds pitch i % 128 shifted by i / 128 + MinPitchShift. Shifting
+	// below the lowest pitch stays at the lowest pitch.
+	constexpr PitchLayout MakeShiftedPitchLayout(int32 i)
 	{
-		int n = base7 % 7;
-		int octave = base7 / 7;
-
-		switch (n)
-		{
-			case 0: return octave * 12 + accidental; // C, C#
-			case 1: return octave * 12 + 2; // D
-			case 2: return octave * 12 + 4 + accidental; // Eb, E
-			case 3: return octave * 12 + 5 + accidental; // F, F#
-			case 4: return octave * 12 + 7 + accidental; // G, G#
-			case 5: return octave * 12 + 9; // A
-			case 6: return octave * 12 + 11 + accidental; // B, Bb
-		}
-		return octave * 12;
+		return MakePitchLayout(i % 128 + i / 128 + MinPitchShift < 0 ? 0 : i % 128 + i / 128 + MinPitchShift);
 	}
 
-	void applyPitchShift(int& base7, int& accidental, int shift)
+	template <typename Seq>
+	struct PitchLayoutTable;
+
+	template <int32... I>
+	struct PitchLayoutTable<std::integer_sequence<int32, I...>>
 	{
-		if (shift != 0)
-		{
-			int p = base7ToBase12(base7, accidental);
-			p += shift;
-			if (p < 0)p = 0;
+		static constexpr PitchLayout Entries[sizeof...(I)] = { MakeShiftedPitchLayout(I)... };
+	};
+
+	template <int32... I>
+	constexpr PitchLayout PitchLayoutTable<std::integer_sequence<int32, I...>>::Entries[sizeof...(I)];
+
+	using PitchLayouts = PitchLayoutTable<std::make_integer_sequence<int32, ShiftCount * 128>>;
+
+	static_assert(PitchLayouts::Entries[(0 - MinPitchShift) * 128 + 63].base7 == 37 &&
+		PitchLayouts::Entries[(0 - MinPitchShift) * 128 + 63].accidental == -1, "pitch 63 is Eb, the flat of white key 37");
+
+	const PitchLayout& getPitchLayout(int32 pitch, int32 shift)
+	{
+		return PitchLayouts::Entries[(shift - MinPitchShift) * 128 + pitch];
+	}
+
+	// moves a white key by a pitch shift, to the column of the shifted pitch
+	int32 shiftBase7(int32 base7, int32 shift)
+	{
+		if (base7 < 0)
+			base7 = 0;
+
+		int32 pitch = base7 / 7 * 12 + Base7Chroma[base7 % 7] + shift;
+		if (pitch < 0)
+			pitch = 0;
+
+		return pitch / 12 * 7 + ChromaBase7[pitch % 12];
+	}
+
+	// notes of even and odd tracks
+	struct NoteColorSet
+	{
+		ColorValue face;
+		ColorValue face_a;
+		ColorValue bg;
+	};
+	const NoteColorSet NoteColorSets[] =
+	{
+		{ 0xffa1e55c, 0xff569d11, 0xff202818 },
+		{ 0xff87aacf, 0xff376bae, 0xff293139 },
+	};
+
+	const ColorValue BarLineColor = 0xff505050;
+	const ColorValue OctaveLineColor = CV_Gray;
+	const ColorValue LabelColor = CV_White;
 
-			base12ToBase7(p, base7, accidental);
+	// FNV-1a of the MIDI file, to name note cache files by its content
+	uint64 ContentHash(const char* data, int64 length)
+	{
+		const int32 ChunkSize = 1 << 30;
+
+		FNVHash64 hash;
+		for (int64 offset = 0; offset < length; offset += ChunkSize)
+			hash.Accumulate(data + offset, length - offset < ChunkSize ? (int32)(length - offset) : ChunkSize);
+		return hash.getResult();
+	}
+
+	// func(i) for every i in [0, count), on the pool's threads or in order on this one
+	void ForEachIndex(WorkerPool* pool, int32 count, FunctorReference<void(int32)> func)
+	{
+		if (pool)
+		{
+			pool->ParallelFor(count, func);
+			return;
 		}
+
+		for (int32 i = 0; i < count; i++)
+			func(i);
 	}
-	void applyPitchShift(int& base7, int shift)
+
+	const char NoteCacheMagic[4] = { 'S', 'R', 'N', 'C' };
+	const uint32 NoteCacheVersion = 2;
+
+	/**
+	 *  The start of a note cache file. The notes, sustains, tracks and bars
+	 *  follow uncompressed, as they are in memory, so that they read
+	 *  straight into the lists.
+	 */
+	struct NoteCacheHeader
+	{
+		char magic[4];
+		uint32 version;
+
+		uint64 sourceHash;
+		int64 sourceLength;
+
+		/** CRC-32 of everything after the header */
+		uint32 dataCRC;
+
+		// element sizes, so a build with other struct layouts rebuilds the cache
+		int32 noteSize;
+		int32 sustainSize;
+		int32 trackSize;
+
+		int32 noteCount;
+		int32 sustainCount;
+		int32 trackCount;
+		int32 barCount;
+
+		int32 minPitchBase7;
+		int32 maxPitchBase7;
+		double duration;
+	};
+
+	// CalculateCRC32 continued over data of any size, as it takes an int32 size
+	uint32 AccumulateCRC32(uint32 crc, const char* data, int64 size)
 	{
-		int dummy = 0;
-		applyPitchShift(base7, dummy, shift);
+		const int32 ChunkSize = 1 << 30;
+
+		for (int64 offset = 0; offset < size; offset += ChunkSize)
+			crc = CalculateCRC32(data + offset, size - offset < ChunkSize ? (int32)(size - offset) : ChunkSize, crc);
+		return crc;
 	}
 }
 
@@ -69,80 +164,137 @@ namespace SR
 {
 	const wchar_t* Note::GetName(int pitchShift) const
 	{
-		int32 st = SemiTone;
-
-		st += pitchShift;
-		if (st < 0)
-			st = 0;
-
-		st %= 12;
-
-		switch (st)
-		{
-			case  0: return L"C";
-			case  1: return L"Db";
-			case  2: return L"D";
-			case  3: return L"Eb";
-			case  4: return L"E";
-			case  5: return L"F";
-			case  6: return L"F#";
-			case  7: return L"G";
-			case  8: return L"Ab";
-			case  9: return L"A";
-			case 10: return L"Bb";
-			case 11: return L"B";
+		pitchShift = Math::Clamp(pitchShift, MinPitchShift, MaxPitchShift);
+
+		return NoteNames[getPitchLayout(Base12, pitchShift).label];
+	}
+
+	void PitchColumns::Update(int32 pitchShift, float pitchRes, int32 minBase7)
+	{
+		pitchShift = Math::Clamp(pitchShift, MinPitchShift, MaxPitchShift);
+
+		if (m_valid && m_pitchShift == pitchShift && m_pitchRes == pitchRes && m_minBase7 == minBase7)
+			return;
+
+		m_valid = true;
+		m_pitchShift = pitchShift;
+		m_pitchRes = pitchRes;
+		m_minBase7 = minBase7;
+
+		int32 whiteWidth = Math::Round(pitchRes);
+		int32 blackWidth = Math::Round(pitchRes * 0.6f);
+		int32 centerOffset = Math::Round(pitchRes / 2);
+
+		for (int32 p = 0; p < 128; p++)
+		{
+			const PitchLayout& pl = getPitchLayout(p, pitchShift);
+
+			float xPos = (float)pl.base7 - minBase7;
+			if (pl.accidental)
+			{
+				xPos += pl.accidental * 0.5f;
+			}
+
+			m_width[p] = pl.accidental ? blackWidth : whiteWidth;
+			m_x[p] = (int32)(xPos * pitchRes) - m_width[p] / 2 + centerOffset;
+			m_accidental[p] = pl.accidental != 0;
+			m_label[p] = (byte)pl.label;
+		}
+	}
+
+	void NoteLabels::Update(Canvas* canvas)
+	{
+		if (m_canvas == canvas)
+			return;
+
+		m_canvas = canvas;
+
+		for (int32 i = 0; i < Count; i++)
+		{
+			m_text[i] = NoteNames[i];
+			m_size[i] = canvas->MeasureString(m_text[i]);
 		}
-		return L"";
 	}
 
 	struct BarModeInfo
 	{
 		int tick = 0;
 		int tickDuration = 0;
+		int order = 0;
 	};
 
-	void Song::Load(const String& file)
+	// what one track contributes to the song
+	struct TrackEvents
 	{
-		MidiFile midi(StringUtils::toPlatformNarrowString(file).c_str());
+		List<Note> notes;
+		List<Sustain> sustains;
+		List<BarModeInfo> barChanges;
 
-		midi.doTimeAnalysis();
+		int32 minPitch = -1;
+		int32 maxPitch = -1;
+	};
+
+	// start times of sounding notes, per channel and key. Overlapping notes
+	// on the same key are paired last in, first out; beyond the depth the
+	// oldest start is dropped.
+	struct NoteStacks
+	{
+		static const int32 Depth = 8;
 
+		double onTime[16][128][Depth];
+		byte count[16][128];
+	};
+
+	static void ExtractTrackEvents(const MidiEventStore& midi, int32 track, NoteStacks& stacks, TrackEvents& result)
+	{
 		struct KeyState
 		{
 			bool on;
 			double onTime;
 		};
 
-		List<BarModeInfo> barChanges;
+		KeyState sustainPedalState = { 0 };
 
-		int32 minPitch = -1;
-		int32 maxPitch = -1;
+		memset(stacks.count, 0, sizeof(stacks.count));
+
+		// note-ons and note-offs make up most of a track
+		int32 eventCount = midi.getNumEvents(track);
+		result.notes.ResizeDiscard(eventCount / 2 + 1);
+
+		const MidiEventRecord* records = midi.getRecords(track);
 
-		for (int i = 0; i < midi.size(); i++)
+		for (int j = 0; j < eventCount; j++)
 		{
-			KeyState keyStates[0xff] = { 0 };
-			KeyState sustainPedalState = { 0 };
+			MidiEventRef m(records[j], midi.getMessage(records[j]), track);
 
-			for (int j = 0; j < midi[i].size(); j++)
+			if (m.isNoteOn())
 			{
-				MidiEvent& m = midi[i][j];
+				int key = m.getKeyNumber() & 0x7f;
+				int channel = m.getChannel();
 
-				if (m.isNoteOn())
-				{
-					int key = m.getKeyNumber();
+				byte& count = stacks.count[channel][key];
+				double* onTimes = stacks.onTime[channel][key];
 
-					keyStates[key].on = true;
-					keyStates[key].onTime = m.seconds;
-				}
-				else if (m.isNoteOff())
+				if (count == NoteStacks::Depth)
 				{
-					int key = m.getKeyNumber();
+					memmove(onTimes, onTimes + 1, (NoteStacks::Depth - 1) * sizeof(double));
+					count--;
+				}
+				onTimes[count++] = m.seconds;
+			}
+			else if (m.isNoteOff())
+			{
+				int key = m.getKeyNumber() & 0x7f;
+				int channel = m.getChannel();
 
-					keyStates[key].on = false;
+				byte& count = stacks.count[channel][key];
 
+				// a note-off without a sounding note has nothing to end
+				if (count > 0)
+				{
 					Note n;
-					n.Track = i;
-					n.Time = keyStates[key].onTime;
+					n.Track = track;
+					n.Time = stacks.onTime[channel][key][--count];
 					n.Duration = m.seconds - n.Time;
 
 					key -= 24;
@@ -153,69 +305,192 @@ namespace SR
 					n.SemiTone = key % 12;
 
 					n.Base12 = key;
-					base12ToBase7(key, n.Base7, n.Accidental);
+					const PitchLayout& pl = getPitchLayout(key, 0);
+					n.Base7 = pl.base7;
+					n.Accidental = pl.accidental;
 
-					m_notes.Add(n);
+					result.notes.Add(n);
 				}
-				else if (m.isController())
+			}
+			else if (m.isController())
+			{
+				int val = m.getP1();
+				if (val == 64)
 				{
-					int val = m.getP1();
-					if (val == 64)
+					bool isOn = m.getP2() >= 64 ? true : false;
+
+					if (isOn)
+					{
+						sustainPedalState.on = true;
+						sustainPedalState.onTime = m.seconds;
+					}
+					else
 					{
-						bool isOn = m.getP2() >= 64 ? true : false;
-
-						if (isOn)
-						{
-							sustainPedalState.on = true;
-							sustainPedalState.onTime = m.seconds;
-						}
-						else
-						{
-							sustainPedalState.on = false;
-
-							Sustain s;
-							s.Track = i;
-							s.Time = sustainPedalState.onTime;
-							s.Duration = m.seconds - s.Time;
-
-							m_sustains.Add(s);
-						}
+						sustainPedalState.on = false;
+
+						Sustain s;
+						s.Track = track;
+						s.Time = sustainPedalState.onTime;
+						s.Duration = m.seconds - s.Time;
+
+						result.sustains.Add(s);
 					}
 				}
-				else if (m.isMeta())
+			}
+			else if (m.isMeta())
+			{
+				int p1 = m.getP1();
+				int p2 = m.getP2();
+				if (p1 == 0x58 && p2 == 0x04)
 				{
-					int p1 = m.getP1();
-					int p2 = m.getP2();
-					if (p1 == 0x58 && p2 == 0x04)
-					{
-						int time0 = m[3];
-						int time1 = 1 << m[4];
+					int time0 = m[3];
+					int time1 = 1 << m[4];
 
-						double quaterCount = time0 / (time1 / 4.0);
+					double quaterCount = time0 / (time1 / 4.0);
 
-						BarModeInfo bi;
-						bi.tick = m.tick;
-						bi.tickDuration = (int)(quaterCount * midi.getTicksPerQuarterNote());
+					BarModeInfo bi;
+					bi.tick = m.tick;
+					bi.tickDuration = (int)(quaterCount * midi.getTicksPerQuarterNote());
 
-						barChanges.Add(bi);
-					}
+					result.barChanges.Add(bi);
 				}
+			}
 
-				if (m.isNote())
-				{
-					int pitch = m.getKeyNumber();
+			if (m.isNote())
+			{
+				int pitch = m.getKeyNumber();
 
-					if (minPitch < 0 || minPitch > pitch)
-					{
-						minPitch = pitch;
-					}
-					if (maxPitch < 0 || maxPitch < pitch)
-					{
-						maxPitch = pitch;
-					}
+				if (result.minPitch < 0 || result.minPitch > pitch)
+				{
+					result.minPitch = pitch;
+				}
+				if (result.maxPitch < 0 || result.maxPitch < pitch)
+				{
+					result.maxPitch = pitch;
 				}
 			}
 		}
+	}
+
+	bool Song::Load(const String& file, const MidiReadFilter* filter, WorkerPool* pool)
+	{
+		// read the whole file in one go and decode it from memory
+		FileStream fs(file);
+		int64 length = fs.getLength();
+		char* buffer = new char[(size_t)length];
+		length = fs.Read(buffer, length);
+
+		bool loaded = LoadFromMemory(buffer, length, filter, pool);
+
+		delete[] buffer;
+		return loaded;
+	}
+
+	bool Song::Open(const String& file, const String& cacheDir, const MidiReadFilter* filter, WorkerPool* pool)
+	{
+		FileStream fs(file);
+		int64 length = fs.getLength();
+		char* buffer = new char[(size_t)length];
+		length = fs.Read(buffer, length);
+
+		String cachePath;
+		uint64 hash = 0;
+
+		if (cacheDir.size() && filter == nullptr)
+		{
+			hash = ContentHash(buffer, length);
+			cachePath = PathUtils::Combine(cacheDir, StringUtils::UIntToStringHex(hash) + L".srnc");
+
+			if (File::FileExists(cachePath) && ReadCache(cachePath, hash, length))
+			{
+				delete[] buffer;
+				return true;
+			}
+		}
+
+		bool loaded = LoadFromMemory(buffer, length, filter, pool);
+		delete[] buffer;
+
+		if (!loaded)
+			return false;
+
+		SortEvents();
+
+		if (cachePath.size())
+			WriteCache(cachePath, hash, length);
+		return true;
+	}
+
+	bool Song::LoadFromMemory(const char* data, int64 length, const MidiReadFilter* filter, WorkerPool* pool)
+	{
+		// the tracks of a type-1 file decode on their own as well, which
+		// only pays off with threads to share them
+		MidiParallelFor parallelFor;
+		if (pool && pool->getThreadCount() > 1)
+		{
+			parallelFor = [pool](int count, const std::function<void(int)>& body)
+			{
+				pool->ParallelFor(count, [&](int32 i) { body(i); });
+			};
+		}
+
+		MidiEventStore midi;
+		if (!midi.read((const uchar*)data, (size_t)length, filter, parallelFor))
+			return false;
+
+		midi.doTimeAnalysis();
+
+		// tracks are independent, so each one is extracted on its own and
+		// the results are joined in track order afterwards. The output does
+		// not depend on the number of threads.
+		List<TrackEvents> tracks;
+		tracks.Reserve(midi.getTrackCount());
+
+		ForEachIndex(pool, midi.getTrackCount(), [&](int32 i)
+		{
+			NoteStacks* stacks = new NoteStacks;
+			ExtractTrackEvents(midi, i, *stacks, tracks[i]);
+			delete stacks;
+		});
+
+		List<BarModeInfo> barChanges;
+
+		int32 minPitch = -1;
+		int32 maxPitch = -1;
+
+		int32 noteCount = 0;
+		int32 sustainCount = 0;
+		for (const TrackEvents& te : tracks)
+		{
+			noteCount += te.notes.getCount();
+			sustainCount += te.sustains.getCount();
+		}
+		if (noteCount > 0)
+			m_notes.Resize(m_notes.getCount() + noteCount);
+		if (sustainCount > 0)
+			m_sustains.Resize(m_sustains.getCount() + sustainCount);
+
+		for (TrackEvents& te : tracks)
+		{
+			m_notes.AddList(te.notes);
+			m_sustains.AddList(te.sustains);
+
+			for (BarModeInfo& bi : te.barChanges)
+			{
+				bi.order = barChanges.getCount();
+				barChanges.Add(bi);
+			}
+
+			if (te.minPitch >= 0 && (minPitch < 0 || minPitch > te.minPitch))
+			{
+				minPitch = te.minPitch;
+			}
+			if (te.maxPitch >= 0 && (maxPitch < 0 || maxPitch < te.maxPitch))
+			{
+				maxPitch = te.maxPitch;
+			}
+		}
+		tracks.Clear();
 
 		if (minPitch > 40)
 		{
@@ -229,9 +504,9 @@ namespace SR
 		minPitch -= 24;
 		maxPitch -= 24;
 
-		int dummy;
-		base12ToBase7(minPitch, m_minPitchBase7, dummy);
-		base12ToBase7(maxPitch, m_maxPitchBase7, dummy);
+		// two octaves down can go below pitch 0, where the lowest key column is
+		m_minPitchBase7 = minPitch < 0 ? 0 : getPitchLayout(minPitch, 0).base7;
+		m_maxPitchBase7 = getPitchLayout(maxPitch, 0).base7;
 
 		m_duration = midi.getTotalTimeInSeconds();
 
@@ -245,65 +520,55 @@ namespace SR
 			barChanges.Add(bi);
 		}
 
-		// generate bar timings by simulating timeline
-		int totalLength = midi.getTotalTimeInTicks();
-		int barModeIdx = 0;
-		int eventIdx = 0;
+		// generate bar timings. A bar ends after its time signature's length
+		// or where the time signature changes, whichever comes first, so bar
+		// lines are found per segment and converted through the tempo map.
+		barChanges.Sort([](const BarModeInfo& a, const BarModeInfo& b)
+		{
+			if (a.tick == b.tick)
+				return OrderComparer(a.order, b.order);
 
-		MidiFile clone = midi;
-		clone.absoluteTicks();
-		clone.joinTracks();
+			return OrderComparer(a.tick, b.tick);
+		});
 
-		int tpq = clone.getTicksPerQuarterNote();
-		double defaultTempo = 120.0;
-		double secondsPerTick = 60.0 / (defaultTempo * tpq);
+		int totalLength = midi.getTotalTimeInTicks();
+		int barModeIdx = 0;
 
-		if (clone[0][0].isTempo())
+		// changes at the very start replace the initial mode
+		while (barModeIdx < barChanges.getCount() - 1 &&
+			barChanges[barModeIdx + 1].tick <= 0)
 		{
-			secondsPerTick = clone[0][0].getTempoSPT(tpq);
+			barModeIdx++;
 		}
 
-		double accumulatedLength = 0;
-		int accumulatedTicks = 0;
-		for (int t = 0; t < totalLength; t++)
+		List<int> barEnds;
+		int barStart = 0;
+		while (barStart < totalLength)
 		{
-			bool barModeChanged = false;
+			int barEnd = totalLength;
 
-			while (barModeIdx < barChanges.getCount() - 1 &&
-				t >= barChanges[barModeIdx + 1].tick)
+			if (barChanges[barModeIdx].tickDuration > 0)
 			{
-				barModeIdx++;
-				barModeChanged = true;
+				barEnd = Math::Min(barEnd, barStart + barChanges[barModeIdx].tickDuration);
 			}
-
-			while (eventIdx < clone[0].getSize() - 1 &&
-				t >= clone[0][eventIdx + 1].tick)
+			if (barModeIdx < barChanges.getCount() - 1)
 			{
-				eventIdx++;
-
-				if (clone[0][eventIdx].isTempo())
-				{
-					secondsPerTick = clone[0][eventIdx].getTempoSPT(tpq);
-				}
+				barEnd = Math::Min(barEnd, barChanges[barModeIdx + 1].tick);
 			}
-			
-			if (accumulatedTicks >= barChanges[barModeIdx].tickDuration || barModeChanged)
-			{
-				AppendBar(accumulatedLength);
 
-				accumulatedLength = 0;
-				accumulatedTicks = 0;
-			}
+			barEnds.Add(barEnd);
+			barStart = barEnd;
 
-			accumulatedTicks++;
-			accumulatedLength += secondsPerTick;
+			while (barModeIdx < barChanges.getCount() - 1 &&
+				barStart >= barChanges[barModeIdx + 1].tick)
+			{
+				barModeIdx++;
+			}
 		}
 
-		// final bar
-		if (accumulatedTicks > 0)
-		{
-			AppendBar(accumulatedLength);
-		}
+		m_bars.Reserve(barEnds.getCount());
+		midi.getTempoMap().getSecondsAtTicks(barEnds.getElements(), m_bars.getElements(), barEnds.getCount());
+		return true;
 	}
 
 	void Song::SortEvents()
@@ -370,35 +635,166 @@ namespace SR
 		{
 			return OrderComparer(a.MedianPitch, b.MedianPitch);
 		});
+
+		BuildIndices();
 	}
 
-	void Song::AppendBar(double duration)
+	void Song::BuildIndices()
 	{
-		if (m_bars.getCount())
-			m_bars.Add(m_bars.LastItem() + duration);
-		else
-			m_bars.Add(duration);
-	}
+		m_noteLayout.Build(m_notes);
 
+		// bar lines have no length
+		m_barIndex.Clear();
+		m_barIndex.AddRun(0, m_bars.getCount(), 0);
+	}
 
-	void Song::Render(Sprite* sprite, float yScroll, float timeResolution, int32 pitchShift)
+	bool Song::ReadCache(const String& path, uint64 sourceHash, int64 sourceLength)
 	{
-		Viewport vp = sprite->getRenderDevice()->getViewport();
-		Size clSize(vp.Width, vp.Height);
+		FileStream fs(path);
+		int64 length = fs.getLength();
+
+		NoteCacheHeader header;
+		if (length < (int64)sizeof(header) || fs.Read((char*)&header, sizeof(header)) != sizeof(header))
+			return false;
 
-		Font* fnt = FontManager::getSingleton().getFont(L"Bender_Black_14_O");
+		int64 rawSize = (int64)header.noteCount * header.noteSize + (int64)header.sustainCount * header.sustainSize +
+			(int64)header.trackCount * header.trackSize + (int64)header.barCount * sizeof(double);
 
-		struct
+		// the arrays fill the rest of the file exactly, which bounds what a damaged header can allocate
+		bool valid = memcmp(header.magic, NoteCacheMagic, sizeof(header.magic)) == 0 &&
+			header.version == NoteCacheVersion && header.sourceHash == sourceHash && header.sourceLength == sourceLength &&
+			header.noteSize == sizeof(Note) && header.sustainSize == sizeof(Sustain) && header.trackSize == sizeof(TrackInfo) &&
+			header.noteCount >= 0 && header.sustainCount >= 0 && header.trackCount >= 0 && header.barCount >= 0 &&
+			rawSize == length - (int64)sizeof(header);
+
+		if (!valid)
+			return false;
+
+		m_notes.Reserve(header.noteCount);
+		m_sustains.Reserve(header.sustainCount);
+		m_tracks.Reserve(header.trackCount);
+		m_bars.Reserve(header.barCount);
+
+		const struct { char* data; int64 size; } arrays[] =
 		{
-			ColorValue face;
-			ColorValue face_a;
-			ColorValue bg;
-		} const colorSets[] =
+			{ (char*)m_notes.getElements(), (int64)m_notes.getCount() * (int64)sizeof(Note) },
+			{ (char*)m_sustains.getElements(), (int64)m_sustains.getCount() * (int64)sizeof(Sustain) },
+			{ (char*)m_tracks.getElements(), (int64)m_tracks.getCount() * (int64)sizeof(TrackInfo) },
+			{ (char*)m_bars.getElements(), (int64)m_bars.getCount() * (int64)sizeof(double) },
+		};
+
+		uint32 crc = 0;
+		for (const auto& a : arrays)
+		{
+			valid = fs.Read(a.data, a.size) == a.size;
+			if (!valid)
+				break;
+
+			crc = AccumulateCRC32(crc, a.data, a.size);
+		}
+
+		if (!valid || crc != header.dataCRC)
+		{
+			m_notes.Clear();
+			m_sustains.Clear();
+			m_tracks.Clear();
+			m_bars.Clear();
+			return false;
+		}
+
+		m_minPitchBase7 = header.minPitchBase7;
+		m_maxPitchBase7 = header.maxPitchBase7;
+		m_duration = header.duration;
+
+		BuildIndices();
+		return true;
+	}
+
+	void Song::WriteCache(const String& path, uint64 sourceHash, int64 sourceLength) const
+	{
+		NoteCacheHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, NoteCacheMagic, sizeof(header.magic));
+		header.version = NoteCacheVersion;
+		header.sourceHash = sourceHash;
+		header.sourceLength = sourceLength;
+
+		header.noteSize = sizeof(Note);
+		header.sustainSize = sizeof(Sustain);
+		header.trackSize = sizeof(TrackInfo);
+
+		header.noteCount = m_notes.getCount();
+		header.sustainCount = m_sustains.getCount();
+		header.trackCount = m_tracks.getCount();
+		header.barCount = m_bars.getCount();
+
+		header.minPitchBase7 = m_minPitchBase7;
+		header.maxPitchBase7 = m_maxPitchBase7;
+		header.duration = m_duration;
+
+		const struct { const char* data; int64 size; } arrays[] =
 		{
-			{ 0xffa1e55c, 0xff569d11, 0xff202818 },
-			{ 0xff87aacf, 0xff376bae, 0xff293139 },
+			{ (const char*)m_notes.getElements(), (int64)m_notes.getCount() * (int64)sizeof(Note) },
+			{ (const char*)m_sustains.getElements(), (int64)m_sustains.getCount() * (int64)sizeof(Sustain) },
+			{ (const char*)m_tracks.getElements(), (int64)m_tracks.getCount() * (int64)sizeof(TrackInfo) },
+			{ (const char*)m_bars.getElements(), (int64)m_bars.getCount() * (int64)sizeof(double) },
 		};
 
+		for (const auto& a : arrays)
+			header.dataCRC = AccumulateCRC32(header.dataCRC, a.data, a.size);
+
+		// the directory is checked up front, but the file can still be in
+		// use or the disk full. Without the cache the song is only decoded
+		// again next time, so that is no reason to fail opening it.
+		try
+		{
+			FileOutStream strm(path);
+			strm.Write((const char*)&header, sizeof(header));
+			for (const auto& a : arrays)
+				strm.Write(a.data, a.size);
+		}
+		catch (const Exception& e)
+		{
+			ApocLog(LOG_System, L"[Open] Can not write the note cache " + path + L": " + e.getMessage(), LOGLVL_Warning);
+		}
+	}
+
+	void Song::GetRenderColors(List<ColorValue>& colors)
+	{
+		for (const NoteColorSet& cs : NoteColorSets)
+		{
+			colors.Add(cs.face);
+			colors.Add(cs.face_a);
+			colors.Add(cs.bg);
+		}
+		colors.Add(BarLineColor);
+		colors.Add(OctaveLineColor);
+		colors.Add(LabelColor);
+
+		// the label font's outline
+		colors.Add(CV_Black);
+	}
+
+	void Song::Render(Canvas* canvas, float yScroll, float timeResolution, int32 pitchShift)
+	{
+		Render(canvas, yScroll, timeResolution, pitchShift, m_renderState);
+	}
+
+	void Song::Render(Canvas* canvas, float yScroll, float timeResolution, int32 pitchShift, RenderState& state) const
+	{
+		Size clSize = canvas->getSize();
+		Rectangle visibleArea = canvas->getVisibleArea();
+
+		pitchShift = Math::Clamp(pitchShift, MinPitchShift, MaxPitchShift);
+
+		PitchColumns& pitchColumns = state.m_pitchColumns;
+		NoteLabels& noteLabels = state.m_noteLabels;
+		List<IntervalRange>& visibleRanges = state.m_visibleRanges;
+		List<Rectangle>& noteRects = state.m_noteRects;
+		List<RenderState::LabelDraw>& labelDraws = state.m_labelDraws;
+
+		noteLabels.Update(canvas);
+
 		const int32 MaxKeyWidth = 35;
 
 		int32 minKeyCount = clSize.Width / MaxKeyWidth;
@@ -406,8 +802,8 @@ namespace SR
 		int32 minBase7 = m_minPitchBase7 - 2;
 		int32 maxBase7 = m_maxPitchBase7 + 2;
 
-		applyPitchShift(minBase7, pitchShift);
-		applyPitchShift(maxBase7, pitchShift);
+		minBase7 = shiftBase7(minBase7, pitchShift);
+		maxBase7 = shiftBase7(maxBase7, pitchShift);
 
 		if (minBase7 < 0) minBase7 = 0;
 		if (maxBase7 <= minBase7) maxBase7 = minBase7 + 1;
@@ -417,15 +813,26 @@ namespace SR
 		const float PitchRes = (float)clSize.Width / pitchCount7;
 		const float timeRes = timeResolution;
 
-		for (const auto& b : m_bars)
+		// only what intersects the time window of the visible rows is drawn.
+		// The window is widened by a pixel for lines drawn on its edges.
+		double viewStart = yScroll + (clSize.Height - visibleArea.getBottom() - 1.0) / timeRes;
+		double viewEnd = yScroll + (clSize.Height - visibleArea.getTop() + 1.0) / timeRes;
+
+		visibleRanges.Clear();
+		m_barIndex.Query(m_bars.getElements(), viewStart, viewEnd, visibleRanges);
+
+		for (const IntervalRange& r : visibleRanges)
 		{
-			Point startPt;
-			Point endPt;
+			for (int32 i = r.first; i < r.first + r.count; i++)
+			{
+				Point startPt;
+				Point endPt;
 
-			startPt.X = 0; endPt.X = clSize.Width;
-			startPt.Y = endPt.Y = clSize.Height - (int32)((b - yScroll) * timeRes);
+				startPt.X = 0; endPt.X = clSize.Width;
+				startPt.Y = endPt.Y = clSize.Height - (int32)((m_bars[i] - yScroll) * timeRes);
 
-			sprite->DrawLine(SystemUI::GetWhitePixel(), startPt, endPt, 0xff505050, 1, LineCapOptions::Butt);
+				canvas->DrawLine(startPt, endPt, BarLineColor, 1);
+			}
 		}
 
 		int32 octaveCount = (maxBase7 - minBase7 + 6) / 7;
@@ -440,55 +847,84 @@ namespace SR
 			startPt.Y = 0; endPt.Y = clSize.Height;
 			startPt.X = endPt.X = (int32)(xPos * PitchRes);
 
-			sprite->DrawLine(SystemUI::GetWhitePixel(), startPt, endPt, CV_Gray, 2, LineCapOptions::Butt);
+			canvas->DrawLine(startPt, endPt, OctaveLineColor, 2);
 
 			xPos += 3;
 			startPt.X = endPt.X = (int32)(xPos * PitchRes);
-			sprite->DrawLine(SystemUI::GetWhitePixel(), startPt, endPt, CV_Gray, 1, LineCapOptions::Butt);
+			canvas->DrawLine(startPt, endPt, OctaveLineColor, 1);
 		}
 
-		for (int i = m_notes.getCount() - 1; i >= 0; i--)
-		{
-			const Note& n = m_notes[i];
+		// key positions only change with the pitch shift and the window width
+		pitchColumns.Update(pitchShift, PitchRes, minBase7);
+
+		NoteLayoutParams layoutParams;
+		layoutParams.yScroll = yScroll;
+		layoutParams.timeResolution = timeRes;
+		layoutParams.viewportHeight = clSize.Height;
+		layoutParams.columns = &pitchColumns;
 
-			int32 base7 = n.Base7;
-			int32 accidental = n.Accidental;
+		visibleRanges.Clear();
+		m_noteLayout.m_index.Query(m_noteLayout.m_time.getElements(), viewStart, viewEnd, visibleRanges);
 
-			applyPitchShift(base7, accidental, pitchShift);
+		int32 visibleCount = 0;
+		for (const IntervalRange& r : visibleRanges)
+			visibleCount += r.count;
 
-			float xPos = (float)base7 - minBase7;
+		noteRects.Reserve(visibleCount);
+		labelDraws.Clear();
 
-			if (accidental)
+		int32 rectOffset = 0;
+		for (const IntervalRange& r : visibleRanges)
+		{
+			m_noteLayout.ComputeRects(r.first, r.count, layoutParams, noteRects.getElements() + rectOffset);
+			rectOffset += r.count;
+		}
+
+		// drawn back to front in note order, as the ranges are in note order
+		for (int32 j = visibleRanges.getCount() - 1; j >= 0; j--)
+		{
+			const IntervalRange& r = visibleRanges[j];
+			rectOffset -= r.count;
+
+			for (int32 k = r.count - 1; k >= 0; k--)
 			{
-				xPos += accidental*0.5f;
-			}
+				int32 i = r.first + k;
 
-			Rectangle area;
-			area.Y = clSize.Height - (int32)((n.Time - yScroll) * timeRes);
-			area.X = (int32)(xPos * PitchRes);
-			area.Width = Math::Round(accidental ? PitchRes*0.6f : PitchRes);
-			area.Height = (int32)(n.Duration * timeRes);
+				// found by start time only, skip notes which ended already
+				if (m_noteLayout.m_time[i] + m_noteLayout.m_duration[i] < viewStart)
+					continue;
 
-			area.Y -= area.Height;
-			area.X -= area.Width / 2;
-			area.X += Math::Round(PitchRes / 2);
+				const Rectangle& area = noteRects[rectOffset + k];
 
-			const auto& colorSet = colorSets[n.Track & 1];
+				int32 pitch = m_noteLayout.m_pitch[i];
+				bool accidental = pitchColumns.m_accidental[pitch];
 
-			sprite->DrawRoundedRect(SystemUI::GetWhitePixel(), area, nullptr, 7.0f, 3, accidental ? colorSet.face_a : colorSet.face);
-			sprite->DrawRoundedRectBorder(SystemUI::GetWhitePixel(), area, nullptr, 1.0f, 6.0f, 3, colorSet.bg);
+				const NoteColorSet& colorSet = NoteColorSets[m_noteLayout.m_track[i] & 1];
 
-			Point labelPos = area.getBottomLeft();
-			String label = n.GetName(pitchShift);
+				canvas->DrawRoundedRectWithBorder(area, 7.0f, 3, accidental ? colorSet.face_a : colorSet.face, 1.0f, 6.0f, colorSet.bg);
 
-			Point labelSize = fnt->MeasureString(label);
+				// labels go on top of all notes afterwards, if the note is tall enough
+				int32 label = pitchColumns.m_label[pitch];
+				const Point& labelSize = noteLabels.m_size[label];
 
-			labelPos.X += (area.Width - labelSize.X) / 2 - 2;
-			labelPos.Y -= labelSize.Y + 2;
+				if (area.Height >= labelSize.Y + 2)
+				{
+					RenderState::LabelDraw ld;
+					ld.pos = area.getBottomLeft();
+					ld.pos.X += (area.Width - labelSize.X) / 2 - 2;
+					ld.pos.Y -= labelSize.Y + 2;
+					ld.label = label;
+					labelDraws.Add(ld);
+				}
+			}
+		}
 
-			fnt->DrawString(sprite, label, labelPos, CV_White);
+		// one run of font quads after all the note shapes
+		for (const RenderState::LabelDraw& ld : labelDraws)
+		{
+			canvas->DrawString(noteLabels.m_text[ld.label], ld.pos, LabelColor);
 		}
 
-		sprite->Flush();
+		canvas->Flush();
 	}
 }
\ No newline at end of file
@@ -1,9 +1,19 @@
 #pragma once
 
 #include "SRCommon.h"
+#include "IntervalIndex.h"
+#include "WorkerPool.h"
+
+struct MidiReadFilter;
 
 namespace SR
 {
+	class Canvas;
+
+	/** Range of pitch shifts in semitones which Song can render */
+	const int32 MinPitchShift = -6;
+	const int32 MaxPitchShift = 5;
+
 	struct Note 
 	{
 		int32 Track = 0;
@@ -28,6 +38,98 @@ namespace SR
 		double Duration = 0;
 	};
 
+	/**
+	 *  Where the notes of each pitch go on screen for one pitch shift and
+	 *  key width. Update() only rebuilds the table when those change.
+	 */
+	struct PitchColumns
+	{
+		void Update(int32 pitchShift, float pitchRes, int32 minBase7);
+
+		int32 m_x[128];					/** left edge of the note */
+		int32 m_width[128];
+		bool m_accidental[128];
+		byte m_label[128];				/** index into NoteLabels */
+
+	private:
+		bool m_valid = false;
+		int32 m_pitchShift = 0;
+		float m_pitchRes = 0;
+		int32 m_minBase7 = 0;
+	};
+
+	/**
+	 *  The 12 note names with their size on one canvas, so drawing a label
+	 *  needs neither a new string nor a measurement.
+	 */
+	struct NoteLabels
+	{
+		static const int32 Count = 12;
+
+		void Update(Canvas* canvas);
+
+		String m_text[Count];
+		Point m_size[Count];
+
+	private:
+		Canvas* m_canvas = nullptr;
+	};
+
+	/**
+	 *  Per frame parameters for NoteLayout::ComputeRects.
+	 */
+	struct NoteLayoutParams
+	{
+		float yScroll = 0;
+		float timeResolution = 1;
+		int32 viewportHeight = 0;
+
+		const PitchColumns* columns = nullptr;
+	};
+
+	/**
+	 *  The notes of a song packed for drawing, one array per field in
+	 *  m_notes order. Horizontal placement comes from PitchColumns by
+	 *  pitch. Every track is a run of ascending start times in m_index.
+	 */
+	struct NoteLayout
+	{
+		void Build(const List<Note>& notes);
+		void Clear();
+
+		/** Computes the screen rectangles of notes [first, first + count). */
+		void ComputeRects(int32 first, int32 count, const NoteLayoutParams& params, Rectangle* result) const;
+
+		int32 getCount() const { return m_time.getCount(); }
+
+		List<float> m_time;
+		List<float> m_duration;
+		List<byte> m_pitch;
+		List<byte> m_track;
+
+		IntervalIndex m_index;
+	};
+
+	/**
+	 *  What Song::Render keeps between calls. Each thread rendering the
+	 *  same song at once needs its own.
+	 */
+	struct RenderState
+	{
+		PitchColumns m_pitchColumns;
+		NoteLabels m_noteLabels;
+
+		List<IntervalRange> m_visibleRanges;
+		List<Rectangle> m_noteRects;
+
+		struct LabelDraw
+		{
+			Point pos;
+			int32 label;
+		};
+		List<LabelDraw> m_labelDraws;
+	};
+
 	struct TrackInfo
 	{
 		int32 ID = 0;
@@ -38,21 +140,53 @@ namespace SR
 
 	struct Song
 	{
-		void Load(const String& file);
+		/**
+		 *  The filter, if any, leaves tracks and channels of the file out.
+		 *  False if the file is not a readable MIDI file, which leaves the song empty.
+		 *  The tracks are decoded on the pool's threads, or one after another
+		 *  on the calling thread without a pool.
+		 */
+		bool Load(const String& file, const MidiReadFilter* filter = nullptr, WorkerPool* pool = &WorkerPool::GetDefault());
 		void SortEvents();
 
-		void Render(Sprite* sprite, float yScroll, float timeResolution, int32 pitchShift);
+		/**
+		 *  Load and SortEvents in one, for a new Song. Given a cacheDir, the
+		 *  finished song is kept there in a file named after the content hash
+		 *  of the MIDI file, and opening a file of the same content again
+		 *  reads that instead of decoding the MIDI. Filtered songs are not
+		 *  cached, and neither are files that do not decode. False for those,
+		 *  the same as Load. A cache file that can not be written is logged
+		 *  and otherwise ignored.
+		 */
+		bool Open(const String& file, const String& cacheDir, const MidiReadFilter* filter = nullptr, WorkerPool* pool = &WorkerPool::GetDefault());
+
+		void Render(Canvas* canvas, float yScroll, float timeResolution, int32 pitchShift);
+		void Render(Canvas* canvas, float yScroll, float timeResolution, int32 pitchShift, RenderState& state) const;
+
+		/** The colors Render draws with, apart from the canvas' clear color */
+		static void GetRenderColors(List<ColorValue>& colors);
 
 		List<Note> m_notes;
 		List<Sustain> m_sustains;
 		List<TrackInfo> m_tracks;
 		List<double> m_bars;
 
+		NoteLayout m_noteLayout;
+		IntervalIndex m_barIndex;
+
+		RenderState m_renderState;
+
 		int32 m_minPitchBase7;
 		int32 m_maxPitchBase7;
-		double m_duration;
+		double m_duration = 0;
 
 	private:
-		void AppendBar(double duration);
+		bool LoadFromMemory(const char* data, int64 length, const MidiReadFilter* filter, WorkerPool* pool);
+
+		/** The note layout and the indices SortEvents builds from the sorted lists */
+		void BuildIndices();
+
+		bool ReadCache(const String& path, uint64 sourceHash, int64 sourceLength);
+		void WriteCache(const String& path, uint64 sourceHash, int64 sourceLength) const;
 	};
 }
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "SRCommon.h"
+
+#include <atomic>
+
+namespace SR
+{
+	/**
+	 *  Passes the slots of a fixed set of buffers from one producer thread
+	 *  to one consumer thread in order, without a lock. Sequence number n
+	 *  lives in slot n % capacity. The producer fills the slots after
+	 *  getWriteSequence() as far as getWritable() allows and publishes them,
+	 *  the consumer reads the published ones from getReadSequence() on and
+	 *  releases them for reuse.
+	 */
+	class SpscRing
+	{
+	public:
+		explicit SpscRing(int32 capacity)
+			: m_capacity(capacity), m_written(0), m_read(0) { }
+
+		int32 getCapacity() const { return m_capacity; }
+		int32 getSlot(int32 sequence) const { return sequence % m_capacity; }
+
+		/** Producer side */
+		int32 getWritable() const { return m_capacity - (m_written.load(std::memory_order_relaxed) - m_read.load(std::memory_order_acquire)); }
+		void Publish(int32 count) { m_written.fetch_add(count, std::memory_order_release); }
+
+		/** Consumer side */
+		int32 getReadable() const { return m_written.load(std::memory_order_acquire) - m_read.load(std::memory_order_relaxed); }
+		void Release(int32 count) { m_read.fetch_add(count, std::memory_order_release); }
+
+		/** How many have been published and released so far. Any thread can ask. */
+		int32 getWriteSequence() const { return m_written.load(std::memory_order_acquire); }
+		int32 getReadSequence() const { return m_read.load(std::memory_order_acquire); }
+
+	private:
+		const int32 m_capacity;
+
+		std::atomic<int32> m_written;
+		std::atomic<int32> m_read;
+	};
+}
@@ -0,0 +1,141 @@
+#include "../SoftwareCanvas.h"
+#include "Tests.h"
+
+#include <chrono>
+#include <cstdio>
+
+using namespace SR;
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	// the export's default width and a screen of rows
+	const int32 Width = 1280;
+	const int32 Height = 720;
+
+	/** Each case repeats for at least this many seconds */
+	const double MinSeconds = 0.5;
+
+	// the colors Song::Render draws notes and lines with
+	const ColorValue NoteColor = 0xffa1e55c;
+	const ColorValue NoteBorderColor = 0xff202818;
+	const ColorValue BarLineColor = 0xff505050;
+	const ColorValue TranslucentColor = 0x80569d11;
+
+	/** Read after each case, so the drawing can not be left out */
+	volatile uint32 s_sink;
+
+	/** Repeats draw, which returns the pixels it covered, and prints the rate */
+	template <typename Func>
+	void Measure(const char* name, const byte* pixels, Func draw)
+	{
+		// once first, so every page has been touched
+		draw();
+
+		int64 pixelCount = 0;
+		double seconds;
+		Clock::time_point start = Clock::now();
+		do
+		{
+			pixelCount += draw();
+			seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		} while (seconds < MinSeconds);
+
+		s_sink = pixels[0] + pixels[Width * Height * 4 - 1];
+
+		printf("%-34s %9.1f Mpixels/s\n", name, pixelCount / seconds * 1e-6);
+	}
+}
+
+void RunCanvasBench()
+{
+	printf("SoftwareCanvas, %d x %d\n\n", Width, Height);
+
+	List<uint32> pixels;
+	pixels.ReserveDiscard(Width * Height);
+	FillSpan(pixels.getElements(), Width * Height, 0xff303030);
+
+	// every coverage value, as on the edges of shapes, with runs of full
+	// coverage as on their inside
+	List<byte> coverage;
+	coverage.ReserveDiscard(Width);
+	for (int32 x = 0; x < Width; x++)
+		coverage[x] = (x & 511) < 256 ? (byte)x : 255;
+
+	const byte* spanPixels = (const byte*)pixels.getElements();
+
+	Measure("FillSpan", spanPixels, [&]()
+	{
+		for (int32 y = 0; y < Height; y++)
+			FillSpan(pixels.getElements() + y * Width, Width, 0xff303030);
+		return (int64)Width * Height;
+	});
+
+	Measure("BlendSpan", spanPixels, [&]()
+	{
+		for (int32 y = 0; y < Height; y++)
+			BlendSpan(pixels.getElements() + y * Width, Width, 0x80115d9d);
+		return (int64)Width * Height;
+	});
+
+	Measure("BlendCoverageSpan", spanPixels, [&]()
+	{
+		for (int32 y = 0; y < Height; y++)
+			BlendCoverageSpan(pixels.getElements() + y * Width, coverage.getElements(), Width, 0xff115d9d);
+		return (int64)Width * Height;
+	});
+
+	SoftwareCanvas canvas(Width, Height, nullptr);
+	canvas.Clear(0xff303030);
+
+	// the note shape of Song::Render, in a grid over the canvas
+	const int32 NoteWidth = 24;
+	const int32 NoteHeight = 60;
+
+	Measure("RoundedRect, note with border", canvas.getPixels(), [&]()
+	{
+		int64 covered = 0;
+		for (int32 y = 0; y + NoteHeight <= Height; y += NoteHeight + 4)
+		{
+			for (int32 x = 0; x + NoteWidth <= Width; x += NoteWidth + 2)
+			{
+				canvas.DrawRoundedRectWithBorder(Rectangle(x, y, NoteWidth, NoteHeight), 7.0f, 3, NoteColor, 1.0f, 6.0f, NoteBorderColor);
+				covered += NoteWidth * NoteHeight;
+			}
+		}
+		return covered;
+	});
+
+	Measure("RoundedRect, tall translucent", canvas.getPixels(), [&]()
+	{
+		int64 covered = 0;
+		for (int32 x = 0; x + NoteWidth <= Width; x += NoteWidth + 2)
+		{
+			canvas.DrawRoundedRect(Rectangle(x, 0, NoteWidth, Height), 7.0f, 3, TranslucentColor);
+			covered += NoteWidth * Height;
+		}
+		return covered;
+	});
+
+	Measure("AxisLine, 1px rows", canvas.getPixels(), [&]()
+	{
+		for (int32 y = 0; y < Height; y++)
+			canvas.DrawLine(Point(0, y), Point(Width, y), BarLineColor, 1);
+		return (int64)Width * Height;
+	});
+
+	Measure("AxisLine, 2px columns", canvas.getPixels(), [&]()
+	{
+		for (int32 x = 1; x < Width; x += 2)
+			canvas.DrawLine(Point(x, 0), Point(x, Height), BarLineColor, 2);
+		return (int64)(Width / 2) * Height * 2;
+	});
+
+	Measure("AxisLine, 1.5px translucent rows", canvas.getPixels(), [&]()
+	{
+		for (int32 y = 0; y < Height; y += 2)
+			canvas.DrawLine(Point(0, y), Point(Width, y), TranslucentColor, 1.5f);
+		return (int64)Width * (Height / 2) * 3 / 2;
+	});
+}
@@ -0,0 +1,71 @@
+#include "../PngWriter.h"
+#include "Tests.h"
+
+#include <cstdio>
+
+using namespace SR;
+
+namespace
+{
+	int32 s_failures = 0;
+
+	void Fail(const char* what, int32 colorCount)
+	{
+		if (s_failures++ < 20)
+			printf("FAIL PaletteQuantizer: %s, %d colors\n", what, colorCount);
+	}
+
+	/** R, G, B, A bytes in memory of a 0xAARRGGBB color */
+	uint32 ToRGBA(ColorValue c)
+	{
+		return (c & 0xff00ff00) | ((c >> 16) & 0xff) | ((c & 0xff) << 16);
+	}
+
+	void TestColorCount(int32 colorCount)
+	{
+		// distinct colors, as multiplying by an odd number is a bijection on 24 bits
+		List<ColorValue> colors;
+		for (int32 i = 0; i < colorCount; i++)
+			colors.Add(0xff000000 | (((uint32)i * 2654435761u) & 0xffffff));
+
+		PaletteQuantizer* quantizer = new PaletteQuantizer(colors);
+		const List<uint32>& palette = quantizer->getPalette();
+
+		int32 baseCount = Math::Min(colorCount, (int32)PaletteQuantizer::MaxColors);
+		int32 pairCount = baseCount * (baseCount - 1) / 2;
+
+		if (palette.getCount() > PaletteQuantizer::MaxColors)
+			Fail("more than 256 entries", colorCount);
+		else if (palette.getCount() < baseCount)
+			Fail("colors left out", colorCount);
+		else if (pairCount > 0 && pairCount <= PaletteQuantizer::MaxColors - baseCount && palette.getCount() < baseCount + pairCount)
+			Fail("a pair without blends though there is room", colorCount);
+
+		// the given colors map to themselves
+		for (int32 i = 0; i < baseCount; i++)
+		{
+			uint32 rgba = ToRGBA(colors[i]);
+			byte index = quantizer->Map(rgba);
+
+			if (index >= palette.getCount() || palette[index] != (rgba & 0xffffff))
+			{
+				Fail("a given color maps elsewhere", colorCount);
+				break;
+			}
+		}
+
+		delete quantizer;
+	}
+}
+
+int RunPaletteQuantizerTest()
+{
+	int32 before = s_failures;
+
+	// past 256 the colors over the limit are dropped
+	for (int32 colorCount = 0; colorCount <= 300; colorCount++)
+		TestColorCount(colorCount);
+
+	printf("%-10s %s\n", "Palette", s_failures == before ? "ok" : "failed");
+	return s_failures;
+}
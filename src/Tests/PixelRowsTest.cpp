@@ -0,0 +1,121 @@
+#include "../PixelRows.h"
+#include "Tests.h"
+
+#include <cstdio>
+#include <cstring>
+
+using namespace SR;
+
+namespace
+{
+	typedef void (*PackKernel)(const byte* src, byte* dst, int32 count);
+
+	struct KernelInfo
+	{
+		const char* name;
+		PackKernel kernel;
+	};
+
+	const KernelInfo Kernels[] =
+	{
+		{ "PackRowRGB", PackRowRGB },
+		{ "scalar", PackRowRGBScalar },
+#if defined(PIXELROWS_SSE2)
+		{ "SSE2", PackRowRGBSSE2 },
+#endif
+#if defined(PIXELROWS_SSSE3)
+		{ "SSSE3", PackRowRGBSSSE3 },
+#endif
+#if defined(PIXELROWS_AVX2)
+		{ "AVX2", PackRowRGBAVX2 },
+#endif
+	};
+
+	const int32 GuardBytes = 64;
+	const byte Guard = 0xcd;
+
+	int32 s_failures = 0;
+
+	void Fail(const char* kernel, const char* what, int32 width, int32 srcOffset, int32 dstOffset)
+	{
+		if (s_failures++ < 20)
+			printf("FAIL %s: %s, width %d, source offset %d, target offset %d\n", kernel, what, width, srcOffset, dstOffset);
+	}
+
+	/** Runs a kernel on rows starting the given bytes past aligned addresses, checking the pixels and the bytes around them */
+	void TestRow(const KernelInfo& k, int32 width, int32 srcOffset, int32 dstOffset)
+	{
+		static byte srcStorage[GuardBytes * 2 + 4 * 2048 + 32];
+		static byte dstStorage[GuardBytes * 2 + 3 * 2048 + 32];
+
+		byte* src = (byte*)(((uintptr_t)srcStorage + GuardBytes + 31) & ~(uintptr_t)31) + srcOffset;
+		byte* dst = (byte*)(((uintptr_t)dstStorage + GuardBytes + 31) & ~(uintptr_t)31) + dstOffset;
+
+		// random bytes, so no two channels of a pixel are related
+		static uint32 seed = 1;
+		for (int32 i = 0; i < width * 4; i++)
+		{
+			seed = seed * 1103515245 + 12345;
+			src[i] = (byte)(seed >> 16);
+		}
+
+		memset(dst - GuardBytes, Guard, width * 3 + GuardBytes * 2);
+
+		k.kernel(src, dst, width);
+
+		for (int32 x = 0; x < width; x++)
+		{
+			if (memcmp(dst + x * 3, src + x * 4, 3))
+			{
+				Fail(k.name, "wrong pixel", width, srcOffset, dstOffset);
+				return;
+			}
+		}
+
+		for (int32 i = 0; i < GuardBytes; i++)
+		{
+			if (dst[-1 - i] != Guard || dst[width * 3 + i] != Guard)
+			{
+				Fail(k.name, "wrote outside the row", width, srcOffset, dstOffset);
+				return;
+			}
+		}
+	}
+
+	void TestKernels()
+	{
+		const int32 wideWidths[] = { 127, 128, 129, 255, 1279, 1280, 1281, 2047 };
+
+		for (const KernelInfo& k : Kernels)
+		{
+			int32 before = s_failures;
+
+			// every count up to a few vector widths covers each tail length.
+			// Canvas rows start on whole pixels, packed rows on any byte.
+			for (int32 srcOffset = 0; srcOffset < 32; srcOffset += 4)
+			{
+				for (int32 dstOffset = 0; dstOffset < 32; dstOffset++)
+				{
+					for (int32 width = 0; width <= 40; width++)
+						TestRow(k, width, srcOffset, dstOffset);
+
+					for (int32 width : wideWidths)
+						TestRow(k, width, srcOffset, dstOffset);
+				}
+			}
+
+			printf("%-10s %s\n", k.name, s_failures == before ? "ok" : "failed");
+		}
+	}
+}
+
+int RunPixelRowsTest()
+{
+	printf("Kernels in this build:");
+	for (const KernelInfo& k : Kernels)
+		printf(" %s", k.name);
+	printf("\n\n");
+
+	TestKernels();
+	return s_failures;
+}
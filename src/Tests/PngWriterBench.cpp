@@ -0,0 +1,160 @@
+#include "../PngWriter.h"
+#include "../SoftwareCanvas.h"
+#include "../WorkerPool.h"
+#include "Tests.h"
+
+#include <libpng/png.h>
+
+#include <chrono>
+#include <cstdio>
+
+using namespace SR;
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	// 80 seconds of song at the default 100 pixels per second
+	const int32 Width = 1280;
+	const int32 Height = 8000;
+
+	/** Rows handed over at a time, as the export used to save them */
+	const int32 SaveRows = 60;
+
+	/** Each encoder runs this many times and the fastest counts */
+	const int32 Runs = 3;
+
+	const wchar_t* const OutputFile = L"SRTests_bench.png";
+
+	/**
+	 *  An image laid out like an export: the background, bar and octave
+	 *  lines, and notes in the shapes and colors Song::Render uses, placed
+	 *  at random. Labels are left out, the canvas has no font.
+	 */
+	void DrawExportLike(SoftwareCanvas& canvas)
+	{
+		const ColorValue faces[] = { 0xffa1e55c, 0xff569d11, 0xff87aacf, 0xff376bae };
+		const ColorValue borders[] = { 0xff202818, 0xff293139 };
+
+		const int32 KeyCount = 52;
+		const float keyWidth = (float)Width / KeyCount;
+
+		canvas.Clear(0xff303030);
+
+		for (int32 y = 0; y < Height; y += 200)
+			canvas.DrawLine(Point(0, y), Point(Width, y), 0xff505050, 1);
+
+		for (int32 key = 0; key < KeyCount; key += 7)
+		{
+			int32 x = (int32)(key * keyWidth);
+			canvas.DrawLine(Point(x, 0), Point(x, Height), CV_Gray, 2);
+
+			x = (int32)((key + 3) * keyWidth);
+			canvas.DrawLine(Point(x, 0), Point(x, Height), CV_Gray, 1);
+		}
+
+		uint32 seed = 1;
+		for (int32 i = 0; i < 3000; i++)
+		{
+			seed = seed * 1103515245 + 12345;
+			int32 key = (seed >> 16) % KeyCount;
+			seed = seed * 1103515245 + 12345;
+			int32 y = (seed >> 16) % Height;
+			seed = seed * 1103515245 + 12345;
+			int32 length = 10 + (seed >> 16) % 190;
+
+			Rectangle rect((int32)(key * keyWidth) + 1, y, (int32)keyWidth - 2, length);
+			canvas.DrawRoundedRectWithBorder(rect, 7.0f, 3, faces[i & 3], 1.0f, 6.0f, borders[i & 1]);
+		}
+	}
+
+	void WriteToStream(png_structp png_ptr, png_bytep data, png_size_t length)
+	{
+		FileOutStream* strm = (FileOutStream*)png_get_io_ptr(png_ptr);
+		strm->Write((const char*)data, length);
+	}
+
+	void Flush(png_structp png_ptr) { }
+
+	/** What StreamInPng did: libpng's default filters and compression, RGBA with alpha set opaque */
+	void EncodeLibpng(const byte* pixels)
+	{
+		FileOutStream strm(OutputFile);
+
+		png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+		png_infop info_ptr = png_create_info_struct(png_ptr);
+
+		png_set_write_fn(png_ptr, &strm, WriteToStream, Flush);
+		png_set_IHDR(png_ptr, info_ptr, Width, Height, 8, PNG_COLOR_TYPE_RGBA, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+		png_write_info(png_ptr, info_ptr);
+
+		png_bytep rows[SaveRows];
+		for (int32 y = 0; y < Height; y += SaveRows)
+		{
+			int32 count = Math::Min(SaveRows, Height - y);
+			for (int32 i = 0; i < count; i++)
+				rows[i] = (png_bytep)(pixels + (size_t)(y + i) * Width * 4);
+
+			png_write_rows(png_ptr, rows, count);
+		}
+
+		png_write_end(png_ptr, NULL);
+		png_destroy_write_struct(&png_ptr, &info_ptr);
+	}
+
+	void EncodeParallel(const byte* pixels, WorkerPool& pool, PngProfile profile, PngColorMode colorMode)
+	{
+		FileOutStream strm(OutputFile);
+		ParallelPngWriter writer(Width, Height, strm, pool, profile, colorMode);
+
+		for (int32 y = 0; y < Height; y += SaveRows)
+			writer.WriteRows(pixels + (size_t)y * Width * 4, Width * 4, Math::Min(SaveRows, Height - y));
+
+		writer.Finish();
+	}
+
+	/** Prints the file size, against the first encoder's, and the rate in MB of RGBA pixels taken in */
+	template <typename Func>
+	void Measure(const char* name, Func encode, int64& baseSize)
+	{
+		double best = 0;
+		for (int32 i = 0; i < Runs; i++)
+		{
+			Clock::time_point start = Clock::now();
+			encode();
+			double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+			if (i == 0 || seconds < best)
+				best = seconds;
+		}
+
+		int64 size = File::GetFileSize(OutputFile);
+		if (baseSize == 0)
+			baseSize = size;
+
+		double inputMB = (double)Width * Height * 4 / 1048576.0;
+		printf("%-36s %8.2f MB %6.1f%% %8.1f MB/s\n", name, size / 1048576.0, 100.0 * size / baseSize, inputMB / best);
+	}
+}
+
+void RunPngWriterBench()
+{
+	SoftwareCanvas canvas(Width, Height, nullptr);
+	DrawExportLike(canvas);
+	const byte* pixels = canvas.getPixels();
+
+	WorkerPool single(1);
+	WorkerPool pool;
+
+	printf("\nPNG encoding, %d x %d export-like image, %d threads in the pool\n\n", Width, Height, pool.getThreadCount());
+
+	int64 baseSize = 0;
+
+	Measure("libpng, StreamInPng settings", [&]() { EncodeLibpng(pixels); }, baseSize);
+	Measure("General, RGBA, 1 thread", [&]() { EncodeParallel(pixels, single, PNGPROF_General, PNGCOL_RGBA); }, baseSize);
+	Measure("FlatColor, RGBA, 1 thread", [&]() { EncodeParallel(pixels, single, PNGPROF_FlatColor, PNGCOL_RGBA); }, baseSize);
+	Measure("FlatColor, RGBA, pool", [&]() { EncodeParallel(pixels, pool, PNGPROF_FlatColor, PNGCOL_RGBA); }, baseSize);
+	Measure("FlatColor, RGB, pool", [&]() { EncodeParallel(pixels, pool, PNGPROF_FlatColor, PNGCOL_RGB); }, baseSize);
+
+	_wremove(OutputFile);
+}
@@ -0,0 +1,28 @@
+#include "Tests.h"
+
+#include <cstdio>
+#include <cstring>
+
+int main(int argc, char** argv)
+{
+	// the benchmarks only run when asked for, the tests are the default
+	if (argc > 1 && !strcmp(argv[1], "-bench"))
+	{
+		RunCanvasBench();
+		RunPngWriterBench();
+		return 0;
+	}
+
+	if (argc > 1)
+	{
+		printf("SRTests [-bench]\n\n"
+			"Runs the tests, or with -bench the benchmarks instead.\n");
+		return 1;
+	}
+
+	int failures = RunPixelRowsTest();
+	failures += RunPaletteQuantizerTest();
+
+	printf("\n%s\n", failures ? "FAILED" : "All passed");
+	return failures ? 1 : 0;
+}
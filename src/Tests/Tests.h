@@ -0,0 +1,13 @@
+#pragma once
+
+/** Checks each PixelRows kernel. Returns the number of failures. */
+int RunPixelRowsTest();
+
+/** Checks the palettes PaletteQuantizer builds. Returns the number of failures. */
+int RunPaletteQuantizerTest();
+
+/** Times the SoftwareCanvas span kernels and the shapes Song::Render draws, in Mpixels/s */
+void RunCanvasBench();
+
+/** Compares the size and speed of the PNG encoders on an export-like image */
+void RunPngWriterBench();
@@ -0,0 +1,129 @@
+#include "WorkerPool.h"
+
+namespace SR
+{
+	WorkerPool::WorkerPool(int32 threadCount)
+		: m_nextItem(0)
+	{
+		if (threadCount <= 0)
+			threadCount = (int32)tthread::thread::hardware_concurrency();
+
+		for (int32 i = 1; i < threadCount; i++)
+		{
+			tthread::thread* th = new tthread::thread(WorkerMainStatic, this);
+			SetThreadName(th, L"Worker " + StringUtils::IntToString(i));
+			m_threads.Add(th);
+		}
+	}
+
+	WorkerPool::~WorkerPool()
+	{
+		m_mutex.lock();
+		m_terminated = true;
+		m_jobReady.notify_all();
+		m_mutex.unlock();
+
+		for (tthread::thread* th : m_threads)
+		{
+			if (th->joinable())
+				th->join();
+			delete th;
+		}
+		m_threads.Clear();
+	}
+
+	void WorkerPool::ParallelFor(int32 count, FunctorReference<void(int32)> func)
+	{
+		if (count <= 0)
+			return;
+
+		if (m_threads.getCount() == 0 || count == 1)
+		{
+			for (int32 i = 0; i < count; i++)
+				func(i);
+			return;
+		}
+
+		// one job at a time, other callers wait for their turn
+		m_callMutex.lock();
+
+		m_mutex.lock();
+		// a worker which woke up after the previous job ended must be done
+		// with it before the item counter is reset
+		while (m_activeWorkers > 0)
+			m_jobDone.wait(m_mutex);
+
+		m_job = func;
+		m_jobCount = count;
+		m_nextItem = 0;
+		m_jobGeneration++;
+		m_jobReady.notify_all();
+		m_mutex.unlock();
+
+		RunItems(func, count);
+
+		// workers that picked up this job may still be running their last item
+		m_mutex.lock();
+		while (m_activeWorkers > 0)
+			m_jobDone.wait(m_mutex);
+		m_job = nullptr;
+		m_jobCount = 0;
+		m_mutex.unlock();
+
+		m_callMutex.unlock();
+	}
+
+	WorkerPool& WorkerPool::GetDefault()
+	{
+		static WorkerPool pool;
+		return pool;
+	}
+
+	void WorkerPool::WorkerMainStatic(void* pool)
+	{
+		((WorkerPool*)pool)->WorkerMain();
+	}
+
+	void WorkerPool::WorkerMain()
+	{
+		uint32 generation = 0;
+
+		m_mutex.lock();
+		for (;;)
+		{
+			while (!m_terminated && m_jobGeneration == generation)
+				m_jobReady.wait(m_mutex);
+
+			if (m_terminated)
+				break;
+
+			// copy the job under the lock. A worker waking up late sees either
+			// the current job or an already finished one with no items left.
+			generation = m_jobGeneration;
+			FunctorReference<void(int32)> job = m_job;
+			int32 count = m_jobCount;
+			m_activeWorkers++;
+			m_mutex.unlock();
+
+			RunItems(job, count);
+
+			m_mutex.lock();
+			m_activeWorkers--;
+			if (m_activeWorkers == 0)
+				m_jobDone.notify_all();
+		}
+		m_mutex.unlock();
+	}
+
+	void WorkerPool::RunItems(FunctorReference<void(int32)> func, int32 count)
+	{
+		for (;;)
+		{
+			int32 i = m_nextItem.fetch_add(1);
+			if (i >= count)
+				break;
+
+			func(i);
+		}
+	}
+}
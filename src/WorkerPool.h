@@ -0,0 +1,52 @@
+#pragma once
+
+#include "SRCommon.h"
+
+#include <atomic>
+
+namespace SR
+{
+	/**
+	 *  A fixed set of worker threads for data parallel loops.
+	 *  The calling thread takes part in the work, so a pool of N threads
+	 *  has N-1 background threads.
+	 */
+	class WorkerPool
+	{
+	public:
+		explicit WorkerPool(int32 threadCount = 0);
+		~WorkerPool();
+
+		/**
+		 *  Calls func(i) for every i in [0, count) and returns once all
+		 *  calls have finished. Items are handed out one at a time, so uneven
+		 *  items balance themselves across the threads. Calls from several
+		 *  threads at once run one after another.
+		 */
+		void ParallelFor(int32 count, FunctorReference<void(int32)> func);
+
+		int32 getThreadCount() const { return m_threads.getCount() + 1; }
+
+		static WorkerPool& GetDefault();
+
+	private:
+		static void WorkerMainStatic(void* pool);
+		void WorkerMain();
+		void RunItems(FunctorReference<void(int32)> func, int32 count);
+
+		List<tthread::thread*> m_threads;
+
+		tthread::mutex m_callMutex;
+		tthread::mutex m_mutex;
+		tthread::condition_variable m_jobReady;
+		tthread::condition_variable m_jobDone;
+
+		FunctorReference<void(int32)> m_job;
+		int32 m_jobCount = 0;
+		uint32 m_jobGeneration = 0;
+		int32 m_activeWorkers = 0;
+		bool m_terminated = false;
+
+		std::atomic<int32> m_nextItem;
+	};
+}